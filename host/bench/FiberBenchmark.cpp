@@ -0,0 +1,311 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Fiber scheduler benchmark for the codal-core-host target.
+  *
+  * Measures the cost of the core scheduler operations (context switch, fiber creation, invoke
+  * with and without fork-on-block, the task queue, wake latency at different priorities, and sleep/wake latency)
+  * using the same code that runs on device.
+  *
+  * Usage: fiber-bench [iterations]
+  */
+
+#include "CodalConfig.h"
+#include "CodalHost.h"
+#include "CodalFiber.h"
+#include "CodalTaskQueue.h"
+#include "HostLowLevelTimer.h"
+#include "Timer.h"
+#include "MessageBus.h"
+
+#include <stdio.h>
+#include <time.h>
+
+using namespace codal;
+
+#define BENCH_ID            4000
+#define BENCH_EVT_WAKE      1
+
+static HostLowLevelTimer lowLevelTimer;
+
+static int iterations = 100000;
+static volatile int completed = 0;
+static volatile int running = 0;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, int n, uint64_t start, uint64_t end)
+{
+    double total = (double)(end - start);
+    printf("%-32s %10d ops %12.1f ns/op %14.0f ops/s\n", name, n, total / n, n * 1e9 / total);
+}
+
+static void noop()
+{
+    completed++;
+}
+
+static void yielder()
+{
+    while (running)
+        schedule();
+}
+
+static void waiter()
+{
+    fiber_wait_for_event(BENCH_ID, BENCH_EVT_WAKE);
+    completed++;
+}
+
+static void bench_context_switch(int fibers)
+{
+    char name[64];
+
+    running = 1;
+    for (int i = 1; i < fibers; i++)
+        create_fiber(yielder);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+        schedule();
+    uint64_t end = now_ns();
+
+    running = 0;
+    for (int i = 1; i < fibers; i++)
+        schedule();
+
+    // Every schedule() from this fiber results in a context switch through each of the other fibers.
+    snprintf(name, sizeof(name), "context switch (%d fibers)", fibers);
+    report(name, iterations * fibers, start, end);
+}
+
+static void bench_create_fiber()
+{
+    completed = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        create_fiber(noop);
+        schedule();
+    }
+    uint64_t end = now_ns();
+
+    report("create_fiber + run + release", completed, start, end);
+}
+
+static void bench_invoke()
+{
+    completed = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+        invoke(noop);
+    uint64_t end = now_ns();
+
+    report("invoke (non-blocking)", completed, start, end);
+}
+
+static void noop_task(void *)
+{
+    completed++;
+}
+
+static void bench_schedule_task()
+{
+    completed = 0;
+
+    // Queue tasks in small batches, as a stream of interrupts might.
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 4)
+    {
+        for (int j = 0; j < 4; j++)
+            schedule_task(noop_task);
+
+        while (task_queue_length())
+            schedule();
+    }
+    uint64_t end = now_ns();
+
+    report("schedule_task + run", completed, start, end);
+}
+
+static void bench_create_fiber_batch()
+{
+    completed = 0;
+
+    // The same work, with a fiber for each job.
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 4)
+    {
+        for (int j = 0; j < 4; j++)
+            create_fiber(noop);
+
+        for (int j = 0; j < 4; j++)
+            schedule();
+    }
+    uint64_t end = now_ns();
+
+    report("create_fiber + run (batches of 4)", completed, start, end);
+}
+
+static void bench_invoke_fork_on_block()
+{
+    completed = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        invoke(waiter);
+        Event(BENCH_ID, BENCH_EVT_WAKE);
+        schedule();
+    }
+    uint64_t end = now_ns();
+
+    report("invoke (fork on block) + wake", completed, start, end);
+}
+
+static void bench_sleep(int period)
+{
+    int n = 20;
+    uint32_t wakeups = lowLevelTimer.interruptCount;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < n; i++)
+        fiber_sleep(period);
+    uint64_t end = now_ns();
+
+    wakeups = lowLevelTimer.interruptCount - wakeups;
+
+    printf("%-32s %10d ops %12.1f us/op (requested %d us, %.1f wake ups/op)\n", "fiber_sleep", n, (double)(end - start) / n / 1000.0, period * 1000, (double)wakeups / n);
+}
+
+static volatile uint64_t wokenAt = 0;
+
+static void latency_waiter()
+{
+    while (running)
+    {
+        fiber_wait_for_event(BENCH_ID, BENCH_EVT_WAKE);
+        wokenAt = now_ns();
+        completed++;
+    }
+}
+
+static void bench_wake_latency(int fibers, int priority)
+{
+    char name[64];
+    uint64_t total = 0;
+
+    // A fiber waiting on an event, competing with a number of busy fibers at the default priority.
+    running = 1;
+    completed = 0;
+    create_fiber(latency_waiter, release_fiber, 0, priority);
+
+    for (int i = 1; i < fibers; i++)
+        create_fiber(yielder);
+
+    schedule();
+
+    for (int i = 0; i < iterations / 10; i++)
+    {
+        int c = completed;
+        uint64_t start = now_ns();
+
+        Event(BENCH_ID, BENCH_EVT_WAKE);
+        while (completed == c)
+            schedule();
+
+        total += wokenAt - start;
+    }
+
+    running = 0;
+    Event(BENCH_ID, BENCH_EVT_WAKE);
+    for (int i = 0; i < fibers; i++)
+        schedule();
+
+    snprintf(name, sizeof(name), "wake latency (%d fibers, pri %d)", fibers, priority);
+    report(name, iterations / 10, 0, total);
+}
+
+static void long_sleeper(void *period)
+{
+    completed++;
+    fiber_sleep((unsigned long)period);
+}
+
+static void bench_scheduler_tick(int sleepers)
+{
+    char name[64];
+
+    // Put a number of fibers to sleep for a long time, as a typical application would.
+    completed = 0;
+    for (int i = 0; i < sleepers; i++)
+        create_fiber(long_sleeper, (void *)(uintptr_t)(1000000 + (i * 7919) % 1000));
+
+    while (completed < sleepers)
+        schedule();
+
+    Event evt(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_TICK, CREATE_ONLY);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+        scheduler_tick(evt);
+    uint64_t end = now_ns();
+
+    snprintf(name, sizeof(name), "scheduler_tick (%d sleepers)", sleepers);
+    report(name, iterations, start, end);
+}
+
+int app_main(int argc, char *argv[])
+{
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+
+    static Timer timer(lowLevelTimer);
+    static MessageBus messageBus;
+
+    scheduler_init(messageBus);
+
+    bench_context_switch(2);
+    bench_context_switch(10);
+    bench_create_fiber();
+    bench_invoke();
+    bench_invoke_fork_on_block();
+    bench_schedule_task();
+    bench_create_fiber_batch();
+    bench_wake_latency(10, DEVICE_FIBER_PRIORITY_NORMAL);
+    bench_wake_latency(10, DEVICE_FIBER_PRIORITY_HIGH);
+    bench_sleep(10);
+    bench_sleep(100);
+    bench_scheduler_tick(32);
+
+    return 0;
+}
@@ -0,0 +1,511 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Heap allocator benchmark for the codal-core-host target.
+  *
+  * Replays allocation traces against a single heap region, calling the allocation policy directly, and reports the
+  * mean and worst case time of each allocation and release, and the fragmentation of free memory at the end. Built twice:
+  * heap-bench-firstfit uses the default first fit policy, and heap-bench-tlsf uses the two level segregated fit policy
+  * (CODAL_HEAP_TLSF=1).
+  *
+  * Three synthetic traces are always run. Recorded traces may also be given: these are the DMESG output of a device
+  * built with CODAL_DEBUG=CODAL_DEBUG_HEAP, of which the "device_malloc: ALLOCATED" and "device_free" lines are used.
+  * Finally, the cost of creating ManagedBuffers on the heap and in a CodalArena is compared, and the accounting of
+  * nested ArenaScopes is checked.
+  *
+  * Usage: heap-bench-firstfit|heap-bench-tlsf [trace.log ...]
+  */
+
+#include "CodalConfig.h"
+#include "CodalHost.h"
+#include "CodalHeapAllocator.h"
+#include "CodalArena.h"
+#include "ManagedBuffer.h"
+#include "ErrorNo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace codal;
+
+#define HEAP_BENCH_SIZE             (64 * 1024)
+#define HEAP_BENCH_OPERATIONS       200000
+#define HEAP_BENCH_FILL_PERCENT     70
+#define HEAP_BENCH_FRAMES           100000
+#define HEAP_BENCH_FRAME_BUFFERS    4
+
+struct HeapOperation
+{
+    int         id;                 // Identifies the allocation, across its allocation and release.
+    uint32_t    size;               // The size of an allocation or resize, or 0 for a release.
+    bool        resize;             // Whether this operation resizes an existing allocation.
+};
+
+struct HeapTrace
+{
+    std::string                 name;
+    std::vector<HeapOperation>  operations;
+    int                         allocations;
+};
+
+static PROCESSOR_WORD_TYPE arena[HEAP_BENCH_SIZE / sizeof(PROCESSOR_WORD_TYPE)];
+static HeapDefinition benchHeap;
+
+static uint32_t seed;
+
+static uint32_t lcg()
+{
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+  * A size typical of codal-core: mostly small objects (events, listeners, strings), some buffers, and the occasional
+  * large block such as a fiber stack.
+  */
+static uint32_t codal_size()
+{
+    uint32_t r = lcg() % 100;
+
+    if (r < 70)
+        return 8 + lcg() % 56;
+
+    if (r < 95)
+        return 64 + lcg() % 448;
+
+    return 512 + lcg() % 3584;
+}
+
+/**
+  * Churns the heap with codal-like sizes, releasing random live blocks to keep it about HEAP_BENCH_FILL_PERCENT full.
+  */
+static void synthesise_churn(HeapTrace &t)
+{
+    std::vector<std::pair<int, uint32_t>> live;
+    uint32_t liveBytes = 0;
+
+    t.name = "synthetic: churn";
+    t.allocations = 0;
+    seed = 0x12345678;
+
+    while ((int)t.operations.size() < HEAP_BENCH_OPERATIONS)
+    {
+        uint32_t size = codal_size();
+
+        while (!live.empty() && liveBytes + size > HEAP_BENCH_SIZE * HEAP_BENCH_FILL_PERCENT / 100)
+        {
+            int i = lcg() % live.size();
+
+            t.operations.push_back({live[i].first, 0});
+            liveBytes -= live[i].second;
+            live[i] = live.back();
+            live.pop_back();
+        }
+
+        t.operations.push_back({t.allocations, size});
+        live.push_back(std::make_pair(t.allocations++, size));
+        liveBytes += size;
+    }
+}
+
+/**
+  * Interleaves short lived small blocks with long lived ones, leaving the heap peppered with small holes.
+  */
+static void synthesise_fragmentation(HeapTrace &t)
+{
+    std::vector<int> shortLived;
+    std::vector<std::pair<int, uint32_t>> longLived;
+    uint32_t longBytes = 0;
+
+    t.name = "synthetic: fragmentation";
+    t.allocations = 0;
+    seed = 0x87654321;
+
+    while ((int)t.operations.size() < HEAP_BENCH_OPERATIONS)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            uint32_t size = 8 + lcg() % 24;
+            t.operations.push_back({t.allocations, size});
+            shortLived.push_back(t.allocations++);
+        }
+
+        uint32_t size = 16 + lcg() % 112;
+
+        if (longBytes + size > HEAP_BENCH_SIZE * HEAP_BENCH_FILL_PERCENT / 200)
+        {
+            int i = lcg() % longLived.size();
+
+            t.operations.push_back({longLived[i].first, 0});
+            longBytes -= longLived[i].second;
+            longLived[i] = longLived.back();
+            longLived.pop_back();
+        }
+
+        t.operations.push_back({t.allocations, size});
+        longLived.push_back(std::make_pair(t.allocations++, size));
+        longBytes += size;
+
+        for (int id : shortLived)
+            t.operations.push_back({id, 0});
+
+        shortLived.clear();
+    }
+}
+
+/**
+  * Grows buffers a little at a time, as when building strings or recording streams, amongst codal-like churn.
+  */
+static void synthesise_growth(HeapTrace &t)
+{
+    std::vector<std::pair<int, uint32_t>> live;
+    uint32_t liveBytes = 0;
+
+    t.name = "synthetic: growth";
+    t.allocations = 0;
+    seed = 0x0badcafe;
+
+    while ((int)t.operations.size() < HEAP_BENCH_OPERATIONS)
+    {
+        int buffer = t.allocations++;
+        uint32_t size = 16 + lcg() % 48;
+        uint32_t limit = 256 + lcg() % 768;
+
+        t.operations.push_back({buffer, size});
+
+        while (size < limit)
+        {
+            uint32_t other = codal_size();
+
+            while (!live.empty() && liveBytes + other > HEAP_BENCH_SIZE * HEAP_BENCH_FILL_PERCENT / 200)
+            {
+                int i = lcg() % live.size();
+
+                t.operations.push_back({live[i].first, 0});
+                liveBytes -= live[i].second;
+                live[i] = live.back();
+                live.pop_back();
+            }
+
+            if (lcg() % 4 == 0)
+            {
+                t.operations.push_back({t.allocations, other});
+                live.push_back(std::make_pair(t.allocations++, other));
+                liveBytes += other;
+            }
+
+            size += 16 + lcg() % 48;
+            t.operations.push_back({buffer, size, true});
+        }
+
+        // Occasionally shrink the finished buffer to fit, before it is released.
+        if (lcg() % 2 == 0)
+            t.operations.push_back({buffer, size / 2, true});
+
+        t.operations.push_back({buffer, 0});
+    }
+}
+
+/**
+  * Reads a trace recorded as DMESG output. Blocks are identified by address, so a block reused after release is
+  * treated as a new allocation.
+  */
+static bool load_trace(const char *filename, HeapTrace &t)
+{
+    FILE *f = fopen(filename, "r");
+    std::map<std::string, int> live;
+    char line[256];
+    char ptr[64];
+    unsigned int size;
+
+    if (f == NULL)
+    {
+        perror(filename);
+        return false;
+    }
+
+    t.name = filename;
+    t.allocations = 0;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        const char *s;
+
+        if ((s = strstr(line, "device_malloc: ALLOCATED:")) != NULL && sscanf(s, "device_malloc: ALLOCATED: %u [%63[^]]]", &size, ptr) == 2)
+        {
+            live[ptr] = t.allocations;
+            t.operations.push_back({t.allocations++, size});
+        }
+        else if ((s = strstr(line, "device_free:")) != NULL && sscanf(s, "device_free: %63s", ptr) == 1)
+        {
+            std::map<std::string, int>::iterator it = live.find(ptr);
+
+            // Ignore releases of blocks allocated before the trace began.
+            if (it == live.end())
+                continue;
+
+            t.operations.push_back({it->second, 0});
+            live.erase(it);
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+/**
+  * Replays a trace against an empty heap. Each block is filled with a pattern on allocation, and checked on release,
+  * so that overlapping allocations are detected.
+  */
+static void replay(const HeapTrace &t)
+{
+    std::vector<void *> blocks(t.allocations, (void *)NULL);
+    std::vector<uint32_t> sizes(t.allocations, 0);
+    uint64_t mallocTotal = 0, mallocWorst = 0, freeTotal = 0, freeWorst = 0, resizeTotal = 0, resizeWorst = 0;
+    int mallocs = 0, frees = 0, resizes = 0, resizedInPlace = 0, resizedByCopy = 0, failures = 0, corrupted = 0;
+
+    benchHeap.heap_start = arena;
+    benchHeap.heap_end = arena + HEAP_BENCH_SIZE / sizeof(PROCESSOR_WORD_TYPE);
+
+    if (device_heap_init(benchHeap) != DEVICE_OK)
+    {
+        printf("%s: heap initialisation failed\n", t.name.c_str());
+        return;
+    }
+
+    for (const HeapOperation &op : t.operations)
+    {
+        if (op.resize)
+        {
+            uint8_t *p = (uint8_t *)blocks[op.id];
+
+            if (p == NULL)
+                continue;
+
+            // Resize in place if possible, otherwise move the block as device_realloc() does.
+            uint64_t start = now_ns();
+            if (device_resize_in(p, op.size, benchHeap) == DEVICE_OK)
+            {
+                resizedInPlace++;
+            }
+            else
+            {
+                uint8_t *q = (uint8_t *)device_malloc_in(op.size, benchHeap);
+
+                if (q != NULL)
+                {
+                    memcpy(q, p, sizes[op.id] < op.size ? sizes[op.id] : op.size);
+                    device_free_in(p, benchHeap);
+                    resizedByCopy++;
+                }
+                p = q;
+            }
+            uint64_t time = now_ns() - start;
+
+            resizeTotal += time;
+            resizeWorst = time > resizeWorst ? time : resizeWorst;
+            resizes++;
+
+            if (p == NULL)
+            {
+                failures++;
+                continue;
+            }
+
+            for (uint32_t i = 0; i < sizes[op.id] && i < op.size; i++)
+                if (p[i] != (op.id & 0xff))
+                {
+                    corrupted++;
+                    break;
+                }
+
+            memset(p, op.id & 0xff, op.size);
+            blocks[op.id] = p;
+            sizes[op.id] = op.size;
+        }
+        else if (op.size)
+        {
+            uint64_t start = now_ns();
+            void *p = device_malloc_in(op.size, benchHeap);
+            uint64_t time = now_ns() - start;
+
+            mallocTotal += time;
+            mallocWorst = time > mallocWorst ? time : mallocWorst;
+            mallocs++;
+
+            if (p == NULL)
+            {
+                failures++;
+                continue;
+            }
+
+            memset(p, op.id & 0xff, op.size);
+            blocks[op.id] = p;
+            sizes[op.id] = op.size;
+        }
+        else if (blocks[op.id])
+        {
+            uint8_t *p = (uint8_t *)blocks[op.id];
+
+            for (uint32_t i = 0; i < sizes[op.id]; i++)
+                if (p[i] != (op.id & 0xff))
+                {
+                    corrupted++;
+                    break;
+                }
+
+            uint64_t start = now_ns();
+            device_free_in(p, benchHeap);
+            uint64_t time = now_ns() - start;
+
+            freeTotal += time;
+            freeWorst = time > freeWorst ? time : freeWorst;
+            frees++;
+            blocks[op.id] = NULL;
+        }
+    }
+
+    printf("%-28s malloc %8d ops %8.1f ns/op %8llu ns worst %6d failed\n", t.name.c_str(), mallocs,
+            mallocs ? (double)mallocTotal / mallocs : 0.0, (unsigned long long)mallocWorst, failures);
+    printf("%-28s free   %8d ops %8.1f ns/op %8llu ns worst %6d corrupted\n", "", frees,
+            frees ? (double)freeTotal / frees : 0.0, (unsigned long long)freeWorst, corrupted);
+
+    uint32_t freeBytes, largestFree;
+    device_heap_free_space_in(benchHeap, freeBytes, largestFree);
+
+    printf("%-28s free space %6u bytes, largest block %6u bytes, %3u%% fragmented\n", "", freeBytes, largestFree,
+            freeBytes ? 100 - (unsigned)((uint64_t)largestFree * 100 / freeBytes) : 0);
+
+    if (resizes)
+        printf("%-28s resize %8d ops %8.1f ns/op %8llu ns worst %6d in place %6d copied\n", "", resizes,
+                (double)resizeTotal / resizes, (unsigned long long)resizeWorst, resizedInPlace, resizedByCopy);
+}
+
+/**
+  * Creates and releases a chain of ManagedBuffers, as a stream pipeline does within each pull.
+  */
+static void frame()
+{
+    ManagedBuffer b;
+
+    for (int j = 0; j < HEAP_BENCH_FRAME_BUFFERS; j++)
+        b = ManagedBuffer(128 << (j & 1), ArenaScope::current(), BufferInitialize::None);
+}
+
+/**
+  * Runs frames with their buffers on the heap (on the host, the C library heap), or in an arena released at the end
+  * of each frame.
+  */
+static void bench_frames(CodalArena *arena)
+{
+    uint64_t start = now_ns();
+
+    for (int i = 0; i < HEAP_BENCH_FRAMES; i++)
+    {
+        if (arena)
+        {
+            ArenaScope scope(*arena);
+            frame();
+        }
+        else
+        {
+            frame();
+        }
+    }
+
+    uint64_t end = now_ns();
+
+    printf("%-28s %8d frames %8.1f ns/frame (%d buffers each)\n", arena ? "ManagedBuffer: arena" : "ManagedBuffer: heap",
+            HEAP_BENCH_FRAMES, (double)(end - start) / HEAP_BENCH_FRAMES, HEAP_BENCH_FRAME_BUFFERS);
+}
+
+/**
+  * Checks that objects are charged to the scope they were allocated within, when a buffer of an outer scope is
+  * released inside a nested scope. Were the arena counted as a whole, the release of the outer buffer would hide the
+  * inner buffer, and the inner scope could end while that buffer is still referenced.
+  */
+static void check_nested_scopes(CodalArena &arena)
+{
+    bool ok;
+
+    ArenaScope outer(arena);
+    ManagedBuffer a(64, &arena);
+
+    {
+        ArenaScope inner(arena);
+        ManagedBuffer b(64, &arena);
+
+        a = ManagedBuffer();
+        ok = outer.getLive() == 0 && inner.getLive() == 1;
+
+        b = ManagedBuffer();
+        ok = ok && inner.getLive() == 0;
+    }
+
+    printf("%-28s %s\n", "ArenaScope: nested release", ok ? "ok" : "FAILED");
+}
+
+int app_main(int argc, char *argv[])
+{
+    HeapTrace churn, fragmentation, growth;
+
+    printf("heap allocator benchmark: %s policy, %d byte heap\n", CONFIG_ENABLED(CODAL_HEAP_TLSF) ? "tlsf" : "first fit", HEAP_BENCH_SIZE);
+
+    synthesise_churn(churn);
+    replay(churn);
+
+    synthesise_fragmentation(fragmentation);
+    replay(fragmentation);
+
+    synthesise_growth(growth);
+    replay(growth);
+
+    for (int i = 1; i < argc; i++)
+    {
+        HeapTrace recorded;
+
+        if (load_trace(argv[i], recorded))
+            replay(recorded);
+    }
+
+    CodalArena scratch(1024);
+    bench_frames(NULL);
+    bench_frames(&scratch);
+    check_nested_scopes(scratch);
+
+    return 0;
+}
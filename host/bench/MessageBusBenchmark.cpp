@@ -0,0 +1,287 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+/**
+  * MessageBus benchmark for the codal-core-host target.
+  *
+  * Measures the number of events per second the MessageBus can deliver, as the number of registered
+  * listeners grows. Each listener is registered against its own source id, as buttons, sensors and timers
+  * typically are, and each event is delivered to exactly one of them. Events are either processed directly, or
+  * raised and taken through the MessageBus event queue. The cost to an interrupt handler of raising an event
+  * directly is compared with pushing it onto an EventRing, and handlers called for each queued event are compared
+  * with MESSAGE_BUS_LISTENER_BATCH handlers, given the queued events together. Built twice: msgbus-bench-list holds all
+  * listeners in a single list (MESSAGE_BUS_LISTENER_BUCKETS=0), and msgbus-bench-indexed uses the default
+  * indexed listener table. msgbus-bench-trace also records a trace (CODAL_TRACE_BUFFER_SIZE), showing its
+  * cost, and writes the trace of the queued events benchmark to a file for codal-trace-to-chrome.
+  *
+  * Usage: msgbus-bench-list|msgbus-bench-indexed [iterations]
+  *        msgbus-bench-trace [iterations] [trace file]
+  */
+
+#include "CodalConfig.h"
+#include "CodalHost.h"
+#include "CodalFiber.h"
+#include "HostLowLevelTimer.h"
+#include "Timer.h"
+#include "MessageBus.h"
+#include "EventRing.h"
+#include "CodalTrace.h"
+
+#include <stdio.h>
+#include <time.h>
+
+using namespace codal;
+
+#define MSGBUS_BENCH_ID_BASE        100
+#define MSGBUS_BENCH_VALUE          1
+
+static HostLowLevelTimer lowLevelTimer;
+static MessageBus *bus;
+
+static int iterations = 100000;
+static volatile int delivered = 0;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, int n, uint64_t start, uint64_t end)
+{
+    double total = (double)(end - start);
+    printf("%-40s %10d ops %12.1f ns/op %14.0f ops/s\n", name, n, total / n, n * 1e9 / total);
+}
+
+static void handler(Event)
+{
+    delivered++;
+}
+
+static void bench_dispatch(int listeners, bool urgent)
+{
+    char name[64];
+    uint16_t flags = urgent ? MESSAGE_BUS_LISTENER_IMMEDIATE : MESSAGE_BUS_LISTENER_NONBLOCKING;
+
+    for (int i = 0; i < listeners; i++)
+        bus->listen(MSGBUS_BENCH_ID_BASE + i, MSGBUS_BENCH_VALUE, handler, flags);
+
+    delivered = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        Event evt(MSGBUS_BENCH_ID_BASE + (i % listeners), MSGBUS_BENCH_VALUE, CREATE_ONLY);
+
+        // Both passes that a queued event goes through: urgent listeners when raised, then standard listeners
+        // once the event is taken from the queue.
+        if (!bus->process(evt, true))
+            bus->process(evt);
+    }
+    uint64_t end = now_ns();
+
+    if (delivered != iterations)
+        printf("expected %d deliveries, saw %d\n", iterations, delivered);
+
+    for (int i = 0; i < listeners; i++)
+        bus->ignore(MSGBUS_BENCH_ID_BASE + i, MSGBUS_BENCH_VALUE, handler);
+
+    // Let the MessageBus release the listeners we've removed when it next idles.
+    fiber_sleep(1);
+
+    snprintf(name, sizeof(name), "%s dispatch (%d listeners)", urgent ? "urgent" : "standard", listeners);
+    report(name, iterations, start, end);
+}
+
+static void bench_queue(int listeners)
+{
+    char name[64];
+
+    for (int i = 0; i < listeners; i++)
+        bus->listen(MSGBUS_BENCH_ID_BASE + i, MSGBUS_BENCH_VALUE, handler, MESSAGE_BUS_LISTENER_NONBLOCKING);
+
+    delivered = 0;
+
+    // Raise events in small batches, as a stream of interrupts might, then have the MessageBus drain its queue
+    // as it would when the scheduler is idle. As this fiber is runnable, each idle event processes one queued event.
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 4)
+    {
+        for (int j = 0; j < 4; j++)
+            Event(MSGBUS_BENCH_ID_BASE + ((i + j) % listeners), MSGBUS_BENCH_VALUE);
+
+        while (delivered < i + 4)
+            Event(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE);
+    }
+    uint64_t end = now_ns();
+
+    if (delivered != iterations)
+        printf("expected %d deliveries, saw %d\n", iterations, delivered);
+
+    for (int i = 0; i < listeners; i++)
+        bus->ignore(MSGBUS_BENCH_ID_BASE + i, MSGBUS_BENCH_VALUE, handler);
+
+    fiber_sleep(1);
+
+    snprintf(name, sizeof(name), "queue + dispatch (%d listeners)", listeners);
+    report(name, iterations, start, end);
+}
+
+static int batches = 0;
+
+static void batch_handler(Event *, int count, void *)
+{
+    delivered += count;
+    batches++;
+}
+
+static void bench_batch(bool batch)
+{
+    char name[64];
+
+    // Use the default listener flags, so that each call is made in a fork on block context.
+    if (batch)
+        bus->listen(MSGBUS_BENCH_ID_BASE, MSGBUS_BENCH_VALUE, batch_handler, NULL);
+    else
+        bus->listen(MSGBUS_BENCH_ID_BASE, MSGBUS_BENCH_VALUE, handler);
+
+    delivered = 0;
+    batches = 0;
+
+    // Fill the MessageBus queue from a high rate source, then let the MessageBus drain it.
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH)
+    {
+        for (int j = 0; j < MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH; j++)
+            Event(MSGBUS_BENCH_ID_BASE, MSGBUS_BENCH_VALUE);
+
+        while (delivered < i + MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH)
+            Event(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE);
+    }
+    uint64_t end = now_ns();
+
+    int expected = (iterations + MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH - 1) / MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH * MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH;
+
+    if (delivered != expected)
+        printf("expected %d deliveries, saw %d\n", expected, delivered);
+
+    if (batch)
+        bus->ignore(MSGBUS_BENCH_ID_BASE, MSGBUS_BENCH_VALUE, batch_handler);
+    else
+        bus->ignore(MSGBUS_BENCH_ID_BASE, MSGBUS_BENCH_VALUE, handler);
+
+    fiber_sleep(1);
+
+    snprintf(name, sizeof(name), "queued events: %s (%d calls)", batch ? "batch handler" : "handler", batch ? batches : delivered);
+    report(name, expected, start, end);
+}
+
+static void bench_irq(int listeners, bool ring)
+{
+    char name[64];
+    uint64_t total = 0;
+
+    // Fibers are paged through a shared stack, so the ring must not live on this fiber's stack.
+    static EventRing events(8);
+
+    for (int i = 0; i < listeners; i++)
+        bus->listen(MSGBUS_BENCH_ID_BASE + i, MSGBUS_BENCH_VALUE, handler, MESSAGE_BUS_LISTENER_NONBLOCKING);
+
+    delivered = 0;
+
+    // Time only the work done in the interrupt handler, for bursts of events.
+    for (int i = 0; i < iterations; i += 8)
+    {
+        uint64_t start = now_ns();
+        for (int j = 0; j < 8; j++)
+        {
+            if (ring)
+                events.push(Event(MSGBUS_BENCH_ID_BASE + ((i + j) % listeners), MSGBUS_BENCH_VALUE, CREATE_ONLY));
+            else
+                Event(MSGBUS_BENCH_ID_BASE + ((i + j) % listeners), MSGBUS_BENCH_VALUE);
+        }
+        total += now_ns() - start;
+
+        while (delivered < i + 8)
+            Event(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE);
+    }
+
+    if (delivered != iterations)
+        printf("expected %d deliveries, saw %d\n", iterations, delivered);
+
+    for (int i = 0; i < listeners; i++)
+        bus->ignore(MSGBUS_BENCH_ID_BASE + i, MSGBUS_BENCH_VALUE, handler);
+
+    fiber_sleep(1);
+
+    snprintf(name, sizeof(name), "irq: %s (%d listeners)", ring ? "EventRing::push" : "Event()", listeners);
+    report(name, iterations, 0, total);
+}
+
+int app_main(int argc, char *argv[])
+{
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+
+    static Timer timer(lowLevelTimer);
+    static MessageBus messageBus;
+
+    bus = &messageBus;
+    scheduler_init(messageBus);
+
+    printf("listener buckets: %d\n", MESSAGE_BUS_LISTENER_BUCKETS);
+
+    bench_dispatch(1, false);
+    bench_dispatch(16, false);
+    bench_dispatch(64, false);
+    bench_dispatch(256, false);
+    bench_dispatch(1, true);
+    bench_dispatch(64, true);
+    bench_dispatch(256, true);
+    bench_queue(1);
+
+#if CODAL_TRACE_BUFFER_SIZE > 0
+    codal_trace_reset();
+#endif
+
+    bench_queue(64);
+
+#if CODAL_TRACE_BUFFER_SIZE > 0
+    const char *path = argc > 2 ? argv[2] : "msgbus-bench.trace";
+    FILE *trace = fopen(path, "wb");
+
+    if (trace != NULL)
+    {
+        fwrite(&codalTraceStore, sizeof(codalTraceStore), 1, trace);
+        fclose(trace);
+        printf("trace written to %s\n", path);
+    }
+#endif
+    bench_batch(false);
+    bench_batch(true);
+    bench_irq(64, false);
+    bench_irq(64, true);
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Wait queue benchmark for the codal-core-host target.
+  *
+  * Measures the cost of delivering events to fibers blocked in fiber_wait_for_event(), as the number
+  * of waiting fibers grows. Built twice: wait-bench-list holds all waiting fibers in a single list
+  * (CODAL_FIBER_WAIT_QUEUE_BUCKETS=0), and wait-bench-hashed uses the default hashed wait queue.
+  *
+  * Usage: wait-bench-list|wait-bench-hashed [iterations]
+  */
+
+#include "CodalConfig.h"
+#include "CodalHost.h"
+#include "CodalFiber.h"
+#include "CodalComponent.h"
+#include "HostLowLevelTimer.h"
+#include "Timer.h"
+#include "MessageBus.h"
+
+#include <stdio.h>
+#include <time.h>
+
+using namespace codal;
+
+#define WAIT_BENCH_VALUE_BASE       100
+#define WAIT_BENCH_VALUE_UNUSED     60000
+
+static HostLowLevelTimer lowLevelTimer;
+
+static int iterations = 100000;
+static volatile int running = 0;
+static volatile int woken = 0;
+static volatile int started = 0;
+static volatile int exited = 0;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, int n, uint64_t start, uint64_t end)
+{
+    double total = (double)(end - start);
+    printf("%-40s %10d ops %12.1f ns/op %14.0f ops/s\n", name, n, total / n, n * 1e9 / total);
+}
+
+static void waiter(void *value)
+{
+    started++;
+
+    while (running)
+    {
+        fiber_wait_for_event(DEVICE_ID_NOTIFY, (uint16_t)(uintptr_t)value);
+        woken++;
+    }
+
+    exited++;
+}
+
+static void bench_wait_queue(int waiters)
+{
+    char name[64];
+
+    // Block a number of fibers, each waiting on its own event value.
+    running = 1;
+    started = 0;
+    for (int i = 0; i < waiters; i++)
+        create_fiber(waiter, (void *)(uintptr_t)(WAIT_BENCH_VALUE_BASE + i));
+
+    while (started < waiters)
+        schedule();
+
+    // The cost of an event that no fiber is waiting on: the scheduler still has to look.
+    Event miss(DEVICE_ID_NOTIFY, WAIT_BENCH_VALUE_UNUSED, CREATE_ONLY);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+        scheduler_event(miss);
+    uint64_t end = now_ns();
+
+    snprintf(name, sizeof(name), "scheduler_event miss (%d waiters)", waiters);
+    report(name, iterations, start, end);
+
+    // The full round trip: raise an event, and run the one fiber it wakes.
+    woken = 0;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        Event(DEVICE_ID_NOTIFY, WAIT_BENCH_VALUE_BASE + (i % waiters));
+        schedule();
+    }
+    end = now_ns();
+
+    snprintf(name, sizeof(name), "event + wake + run (%d waiters)", waiters);
+    report(name, woken, start, end);
+
+    // Release the waiting fibers.
+    running = 0;
+    exited = 0;
+    for (int i = 0; i < waiters; i++)
+        Event(DEVICE_ID_NOTIFY, WAIT_BENCH_VALUE_BASE + i);
+
+    while (exited < waiters)
+        schedule();
+}
+
+int app_main(int argc, char *argv[])
+{
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+
+    static Timer timer(lowLevelTimer);
+    static MessageBus messageBus;
+
+    scheduler_init(messageBus);
+
+    printf("wait queue buckets: %d\n", CODAL_FIBER_WAIT_QUEUE_BUCKETS);
+
+    bench_wait_queue(1);
+    bench_wait_queue(10);
+    bench_wait_queue(50);
+    bench_wait_queue(200);
+
+    return 0;
+}
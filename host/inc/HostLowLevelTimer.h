@@ -0,0 +1,87 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HOST_LOW_LEVEL_TIMER_H
+#define HOST_LOW_LEVEL_TIMER_H
+
+#include "CodalConfig.h"
+#include "LowLevelTimer.h"
+
+#define HOST_TIMER_CHANNEL_COUNT        4
+
+namespace codal
+{
+    /**
+      * A LowLevelTimer backed by the host's monotonic clock.
+      *
+      * The counter ticks in microseconds. There are no real interrupts on the host, so compare
+      * matches are delivered by poll(), which the host HAL calls whenever the CPU would otherwise
+      * sleep (target_scheduler_idle, target_wait_for_event and target_wait).
+      */
+    class HostLowLevelTimer : public LowLevelTimer
+    {
+        uint32_t compare[HOST_TIMER_CHANNEL_COUNT];
+        uint8_t armed;
+        bool enabled;
+        bool irqEnabled;
+        uint64_t epoch;
+
+        public:
+
+        static HostLowLevelTimer *instance;
+
+        uint32_t interruptCount;            // The number of "interrupts" delivered so far, i.e. CPU wake ups.
+
+        HostLowLevelTimer();
+
+        virtual int enable();
+        virtual int enableIRQ();
+        virtual int disable();
+        virtual int disableIRQ();
+        virtual int reset();
+        virtual int setMode(TimerMode t);
+        virtual int setCompare(uint8_t channel, uint32_t value);
+        virtual int offsetCompare(uint8_t channel, uint32_t value);
+        virtual int clearCompare(uint8_t channel);
+        virtual uint32_t captureCounter();
+        virtual int setClockSpeed(uint32_t speedKHz);
+        virtual int setBitMode(TimerBitMode t);
+
+        /**
+          * Delivers any compare matches that are due to the registered IRQ handler.
+          *
+          * @return 1 if an "interrupt" was delivered, 0 otherwise.
+          */
+        int poll();
+
+        /**
+          * Determines how long until the next armed compare channel matches.
+          *
+          * @return the number of microseconds until the next match, or -1 if no channel is armed.
+          */
+        int32_t nextMatchUs();
+    };
+}
+
+#endif
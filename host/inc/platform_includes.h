@@ -0,0 +1,77 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Platform definitions for the codal-core-host target.
+  *
+  * This target runs codal-core on a Linux host, so that the fiber scheduler, MessageBus and heap
+  * can be exercised and benchmarked without hardware in the loop.
+  */
+
+#ifndef PLATFORM_INCLUDES
+#define PLATFORM_INCLUDES
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#if !defined(__x86_64__)
+#error "codal-core-host currently only supports x86_64 Linux hosts"
+#endif
+
+// Native pointer width, used for all register and stack address arithmetic.
+#define PROCESSOR_WORD_TYPE                 uintptr_t
+
+// Fiber stacks and other runtime allocations come from the C library heap.
+#ifndef DEVICE_HEAP_ALLOCATOR
+#define DEVICE_HEAP_ALLOCATOR               0
+#endif
+
+#ifndef CODAL_TIMER_32BIT
+#define CODAL_TIMER_32BIT                   1
+#endif
+
+// Host stack frames are considerably larger than on a microcontroller.
+#ifndef CODAL_FIBER_STACK_SIZE
+#define CODAL_FIBER_STACK_SIZE              (32 * 1024)
+#endif
+
+// There is no flash on the host, so nothing needs relocating into RAM.
+#define REAL_TIME_FUNC
+#define FORCE_RAM_FUNC __attribute__((noinline))
+
+// Size of the emulated system stack that all paged fibers share.
+#ifndef CODAL_HOST_STACK_SIZE
+#define CODAL_HOST_STACK_SIZE               (256 * 1024)
+#endif
+
+// Headroom reported by get_current_sp() to cover the frames swap_context() and save_context()
+// place below the caller before the stack is paged out.
+#ifndef CODAL_HOST_STACK_SLACK
+#define CODAL_HOST_STACK_SLACK              1024
+#endif
+
+#endif
@@ -0,0 +1,179 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "HostLowLevelTimer.h"
+#include "ErrorNo.h"
+
+#include <time.h>
+
+using namespace codal;
+
+HostLowLevelTimer *HostLowLevelTimer::instance = NULL;
+
+static uint64_t host_monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+HostLowLevelTimer::HostLowLevelTimer() : LowLevelTimer(HOST_TIMER_CHANNEL_COUNT)
+{
+    memset(compare, 0, sizeof(compare));
+    armed = 0;
+    interruptCount = 0;
+    enabled = false;
+    irqEnabled = false;
+    bitMode = BitMode32;
+    epoch = host_monotonic_us();
+
+    instance = this;
+}
+
+int HostLowLevelTimer::enable()
+{
+    enabled = true;
+    return DEVICE_OK;
+}
+
+int HostLowLevelTimer::enableIRQ()
+{
+    irqEnabled = true;
+    return DEVICE_OK;
+}
+
+int HostLowLevelTimer::disable()
+{
+    enabled = false;
+    return DEVICE_OK;
+}
+
+int HostLowLevelTimer::disableIRQ()
+{
+    irqEnabled = false;
+    return DEVICE_OK;
+}
+
+int HostLowLevelTimer::reset()
+{
+    epoch = host_monotonic_us();
+    armed = 0;
+    return DEVICE_OK;
+}
+
+int HostLowLevelTimer::setMode(TimerMode t)
+{
+    return t == TimerModeTimer ? DEVICE_OK : DEVICE_NOT_SUPPORTED;
+}
+
+int HostLowLevelTimer::setCompare(uint8_t channel, uint32_t value)
+{
+    if (channel >= HOST_TIMER_CHANNEL_COUNT)
+        return DEVICE_INVALID_PARAMETER;
+
+    compare[channel] = value;
+    armed |= 1 << channel;
+
+    return DEVICE_OK;
+}
+
+int HostLowLevelTimer::offsetCompare(uint8_t channel, uint32_t value)
+{
+    if (channel >= HOST_TIMER_CHANNEL_COUNT)
+        return DEVICE_INVALID_PARAMETER;
+
+    return setCompare(channel, compare[channel] + value);
+}
+
+int HostLowLevelTimer::clearCompare(uint8_t channel)
+{
+    if (channel >= HOST_TIMER_CHANNEL_COUNT)
+        return DEVICE_INVALID_PARAMETER;
+
+    armed &= ~(1 << channel);
+    return DEVICE_OK;
+}
+
+uint32_t HostLowLevelTimer::captureCounter()
+{
+    return (uint32_t)(host_monotonic_us() - epoch);
+}
+
+int HostLowLevelTimer::setClockSpeed(uint32_t speedKHz)
+{
+    // The host counter always runs at 1MHz.
+    return speedKHz == 1000 ? DEVICE_OK : DEVICE_NOT_SUPPORTED;
+}
+
+int HostLowLevelTimer::setBitMode(TimerBitMode t)
+{
+    return t == BitMode32 ? DEVICE_OK : DEVICE_NOT_SUPPORTED;
+}
+
+int HostLowLevelTimer::poll()
+{
+    if (!enabled || !irqEnabled || timer_pointer == NULL)
+        return 0;
+
+    uint32_t now = captureCounter();
+    uint16_t fired = 0;
+
+    for (int i = 0; i < HOST_TIMER_CHANNEL_COUNT; i++)
+    {
+        if ((armed & (1 << i)) && (int32_t)(now - compare[i]) >= 0)
+        {
+            armed &= ~(1 << i);
+            fired |= 1 << i;
+        }
+    }
+
+    if (fired == 0)
+        return 0;
+
+    interruptCount++;
+    timer_pointer(fired);
+    return 1;
+}
+
+int32_t HostLowLevelTimer::nextMatchUs()
+{
+    uint32_t now = captureCounter();
+    int32_t next = -1;
+
+    for (int i = 0; i < HOST_TIMER_CHANNEL_COUNT; i++)
+    {
+        if (armed & (1 << i))
+        {
+            int32_t delta = (int32_t)(compare[i] - now);
+
+            if (delta < 0)
+                delta = 0;
+
+            if (next < 0 || delta < next)
+                next = delta;
+        }
+    }
+
+    return next;
+}
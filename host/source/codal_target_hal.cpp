@@ -0,0 +1,389 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Target HAL for the codal-core-host target.
+  *
+  * Fibers on a device share one system stack, which the scheduler pages in and out of a per-fiber
+  * heap buffer on every context switch. We reproduce that model faithfully here: all fibers run on
+  * an emulated system stack, swap_context() and save_context() are built on ucontext, and the stack
+  * copies are performed from a private switcher context so that we never copy over our own frame.
+  *
+  * There are no interrupts on the host. The HostLowLevelTimer delivers its compare matches whenever
+  * the CPU would otherwise sleep, which is where a device would normally take its timer interrupt.
+  */
+
+#include "CodalConfig.h"
+#include "codal_target_hal.h"
+#include "CodalFiber.h"
+#include "CodalHost.h"
+#include "HostLowLevelTimer.h"
+#include "ErrorNo.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+
+using namespace codal;
+
+#define HOST_SWITCH_STACK_SIZE      16384
+
+struct HostTCB
+{
+    // Register context, used by save_register_context() and restore_register_context().
+    // The layout of these fields is shared with HostContextSwitch.S.
+    PROCESSOR_WORD_TYPE rbx, rbp, r12, r13, r14, r15;
+    PROCESSOR_WORD_TYPE sp;
+    PROCESSOR_WORD_TYPE lr;
+    PROCESSOR_WORD_TYPE args[3];
+
+    // Paged context, used by swap_context() and save_context().
+    PROCESSOR_WORD_TYPE stack_base;
+    int fresh;
+    ucontext_t context;
+};
+
+static_assert(offsetof(HostTCB, sp) == 48 && offsetof(HostTCB, args) == 64, "HostTCB layout must match HostContextSwitch.S");
+
+static uint8_t host_system_stack[CODAL_HOST_STACK_SIZE] __attribute__((aligned(16)));
+static uint8_t host_switch_stack[HOST_SWITCH_STACK_SIZE] __attribute__((aligned(16)));
+
+static ucontext_t host_main_context;
+static ucontext_t host_app_context;
+static ucontext_t host_switch_context;
+
+// Parameters of the context switch in progress, consumed by host_switch().
+static HostTCB *switch_from;
+static HostTCB *switch_to;
+static PROCESSOR_WORD_TYPE switch_from_stack;
+static PROCESSOR_WORD_TYPE switch_to_stack;
+static HostTCB *launch_tcb;
+static volatile int host_resumed = 0;
+
+static int irq_disable_depth = 0;
+
+static int host_argc;
+static char **host_argv;
+static int host_exit_code = 0;
+
+static PROCESSOR_WORD_TYPE host_context_sp(HostTCB *t)
+{
+    return (PROCESSOR_WORD_TYPE) t->context.uc_mcontext.gregs[REG_RSP];
+}
+
+/**
+  * Copies the live stack of the given context out to the top of its stack buffer.
+  */
+static void host_page_out(HostTCB *t, PROCESSOR_WORD_TYPE stack)
+{
+    PROCESSOR_WORD_TYPE sp = host_context_sp(t);
+    PROCESSOR_WORD_TYPE depth = t->stack_base - sp;
+
+    memcpy((void *)(stack - depth), (void *)sp, depth);
+}
+
+/**
+  * Copies a previously paged out stack back onto the system stack.
+  */
+static void host_page_in(HostTCB *t, PROCESSOR_WORD_TYPE stack)
+{
+    PROCESSOR_WORD_TYPE sp = host_context_sp(t);
+    PROCESSOR_WORD_TYPE depth = t->stack_base - sp;
+
+    memcpy((void *)sp, (void *)(stack - depth), depth);
+}
+
+/**
+  * Entry point of fibers whose TCB has been configured through tcb_configure_lr().
+  */
+static void host_fiber_entry()
+{
+    HostTCB *t = launch_tcb;
+
+    ((void (*)(PROCESSOR_WORD_TYPE, PROCESSOR_WORD_TYPE, PROCESSOR_WORD_TYPE)) t->lr)(t->args[0], t->args[1], t->args[2]);
+
+    // Fibers are recycled by their completion routine, and never return here.
+    target_panic(DEVICE_HARDWARE_CONFIGURATION_ERROR);
+}
+
+/**
+  * Performs the stack copies of a context switch. Runs on its own private stack.
+  */
+static void host_switch()
+{
+    HostTCB *t = switch_to;
+
+    if (switch_from)
+        host_page_out(switch_from, switch_from_stack);
+
+    if (t->fresh)
+    {
+        t->fresh = 0;
+
+        getcontext(&t->context);
+        t->context.uc_stack.ss_sp = host_system_stack;
+        t->context.uc_stack.ss_size = t->sp + sizeof(PROCESSOR_WORD_TYPE) - (PROCESSOR_WORD_TYPE)host_system_stack;
+        t->context.uc_link = NULL;
+        makecontext(&t->context, host_fiber_entry, 0);
+
+        launch_tcb = t;
+    }
+    else
+    {
+        host_page_in(t, switch_to_stack);
+    }
+
+    host_resumed = 1;
+    setcontext(&t->context);
+}
+
+static void host_app_entry()
+{
+    host_exit_code = app_main(host_argc, host_argv);
+}
+
+/**
+  * Sleeps until the next timer compare match is due (or limitUs elapses), then delivers it.
+  */
+static void host_wait_for_interrupt(int32_t limitUs)
+{
+    HostLowLevelTimer *timer = HostLowLevelTimer::instance;
+
+    if (timer && timer->poll())
+        return;
+
+    int32_t next = timer ? timer->nextMatchUs() : -1;
+
+    // Nothing can wake us other than the timer, so don't sleep for too long if it is not armed.
+    if (next < 0)
+        next = 1000;
+
+    if (limitUs >= 0 && limitUs < next)
+        next = limitUs;
+
+    if (next > 0)
+    {
+        struct timespec ts;
+        ts.tv_sec = next / 1000000;
+        ts.tv_nsec = (next % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    }
+
+    if (timer)
+        timer->poll();
+}
+
+int main(int argc, char *argv[])
+{
+    host_argc = argc;
+    host_argv = argv;
+
+    getcontext(&host_switch_context);
+    host_switch_context.uc_stack.ss_sp = host_switch_stack;
+    host_switch_context.uc_stack.ss_size = sizeof(host_switch_stack);
+    host_switch_context.uc_link = NULL;
+
+    // Run the application on the emulated system stack.
+    getcontext(&host_app_context);
+    host_app_context.uc_stack.ss_sp = host_system_stack;
+    host_app_context.uc_stack.ss_size = fiber_initial_stack_base() - (PROCESSOR_WORD_TYPE)host_system_stack;
+    host_app_context.uc_link = &host_main_context;
+    makecontext(&host_app_context, host_app_entry, 0);
+
+    swapcontext(&host_main_context, &host_app_context);
+
+    return host_exit_code;
+}
+
+extern "C"
+{
+
+void target_enable_irq()
+{
+    if (irq_disable_depth > 0)
+        irq_disable_depth--;
+}
+
+void target_disable_irq()
+{
+    irq_disable_depth++;
+}
+
+int target_in_irq()
+{
+    // Timer "interrupts" are delivered by polling from the idle fiber, never asynchronously.
+    return 0;
+}
+
+void target_reset()
+{
+    fflush(stdout);
+    exit(0);
+}
+
+void target_wait(uint32_t milliseconds)
+{
+    struct timespec now, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += milliseconds / 1000;
+    end.tv_nsec += (milliseconds % 1000) * 1000000;
+
+    if (end.tv_nsec >= 1000000000)
+    {
+        end.tv_sec++;
+        end.tv_nsec -= 1000000000;
+    }
+
+    while (1)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        int64_t remaining = (int64_t)(end.tv_sec - now.tv_sec) * 1000000 + (end.tv_nsec - now.tv_nsec) / 1000;
+
+        if (remaining <= 0)
+            break;
+
+        host_wait_for_interrupt(remaining > INT32_MAX ? INT32_MAX : (int32_t)remaining);
+    }
+}
+
+uint64_t target_get_serial()
+{
+    return (uint64_t)gethostid();
+}
+
+void target_scheduler_idle()
+{
+    host_wait_for_interrupt(-1);
+}
+
+void target_wait_for_event()
+{
+    host_wait_for_interrupt(-1);
+}
+
+void target_panic(int statusCode)
+{
+    fprintf(stderr, "*** CODAL PANIC : [%d]\n", statusCode);
+    fflush(stdout);
+    abort();
+}
+
+PROCESSOR_WORD_TYPE fiber_initial_stack_base()
+{
+    return ((PROCESSOR_WORD_TYPE)host_system_stack + sizeof(host_system_stack)) & ~(PROCESSOR_WORD_TYPE)0xF;
+}
+
+void *tcb_allocate()
+{
+    return calloc(1, sizeof(HostTCB));
+}
+
+void tcb_configure_lr(void *tcb, PROCESSOR_WORD_TYPE function)
+{
+    HostTCB *t = (HostTCB *)tcb;
+
+    t->lr = function;
+    t->fresh = 1;
+}
+
+void tcb_configure_sp(void *tcb, PROCESSOR_WORD_TYPE sp)
+{
+    HostTCB *t = (HostTCB *)tcb;
+
+    // Present the stack as if a call had just been made to the entry point, as the ABI requires.
+    t->sp = (sp & ~(PROCESSOR_WORD_TYPE)0xF) - sizeof(PROCESSOR_WORD_TYPE);
+    t->fresh = 1;
+}
+
+void tcb_configure_stack_base(void *tcb, PROCESSOR_WORD_TYPE stack_base)
+{
+    ((HostTCB *)tcb)->stack_base = stack_base;
+}
+
+PROCESSOR_WORD_TYPE tcb_get_stack_base(void *tcb)
+{
+    return ((HostTCB *)tcb)->stack_base;
+}
+
+PROCESSOR_WORD_TYPE get_current_sp()
+{
+    PROCESSOR_WORD_TYPE sp;
+
+    __asm__ __volatile__("movq %%rsp, %0" : "=r" (sp));
+
+    return sp - CODAL_HOST_STACK_SLACK;
+}
+
+PROCESSOR_WORD_TYPE tcb_get_sp(void *tcb)
+{
+    return ((HostTCB *)tcb)->sp;
+}
+
+void tcb_configure_args(void *tcb, PROCESSOR_WORD_TYPE ep, PROCESSOR_WORD_TYPE cp, PROCESSOR_WORD_TYPE pm)
+{
+    HostTCB *t = (HostTCB *)tcb;
+
+    t->args[0] = ep;
+    t->args[1] = cp;
+    t->args[2] = pm;
+}
+
+void swap_context(void *from_tcb, PROCESSOR_WORD_TYPE from_stack, void *to_tcb, PROCESSOR_WORD_TYPE to_stack)
+{
+    switch_from = (HostTCB *)from_tcb;
+    switch_from_stack = from_stack;
+    switch_to = (HostTCB *)to_tcb;
+    switch_to_stack = to_stack;
+
+    makecontext(&host_switch_context, host_switch, 0);
+
+    if (from_tcb == NULL)
+        setcontext(&host_switch_context);
+
+    swapcontext(&switch_from->context, &host_switch_context);
+    host_resumed = 0;
+}
+
+void save_context(void *tcb, PROCESSOR_WORD_TYPE stack)
+{
+    HostTCB *t = (HostTCB *)tcb;
+
+    host_resumed = 0;
+    getcontext(&t->context);
+
+    // If we've been paged back in by swap_context(), we're done.
+    if (host_resumed)
+    {
+        host_resumed = 0;
+        return;
+    }
+
+    t->fresh = 0;
+    host_page_out(t, stack);
+}
+
+}
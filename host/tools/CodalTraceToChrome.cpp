@@ -0,0 +1,316 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+/**
+  * Converts a dump of the codal-core trace ring (see CodalTrace.h) into Chrome trace JSON, for viewing in
+  * chrome://tracing or Perfetto.
+  *
+  * The dump is a binary image of codalTraceStore, as written by GDB with
+  * 'dump binary value trace.bin codalTraceStore', or by a host build that writes it out directly.
+  *
+  * The output holds two processes:
+  *  - "MessageBus": a track per fiber, showing each event handler as it runs, with queued, merged and dropped
+  *    events as instants. Each delivered event is also shown as an async span, from the point it was queued
+  *    to the return of the last handler to see it before the next event with the same source and value was
+  *    dispatched.
+  *  - "Scheduler": a track per fiber, showing when it was scheduled in.
+  *
+  * Usage: codal-trace-to-chrome trace.bin [trace.json]
+  */
+
+#include "CodalConfig.h"
+#include "CodalTrace.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#define TRACE_PID_MESSAGE_BUS       1
+#define TRACE_PID_SCHEDULER         2
+
+/**
+  * An event that has been dispatched, and whose handlers may still be running.
+  */
+struct TraceDelivery
+{
+    uint32_t id;                    // The id of the async span for this event.
+    uint64_t end;                   // The time the last handler for this event returned.
+};
+
+static FILE *out;
+static bool first = true;
+
+static void emit_begin()
+{
+    fprintf(out, first ? "\n  " : ",\n  ");
+    first = false;
+}
+
+static void emit_event(const char *ph, int pid, int tid, uint64_t ts, const char *name, const char *cat)
+{
+    emit_begin();
+    fprintf(out, "{\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%llu,\"name\":\"%s\",\"cat\":\"%s\"", ph, pid, tid, (unsigned long long)ts, name, cat);
+}
+
+static void emit_instant(int tid, uint64_t ts, const char *name)
+{
+    emit_event("i", TRACE_PID_MESSAGE_BUS, tid, ts, name, "event");
+    fprintf(out, ",\"s\":\"t\"}");
+}
+
+static void emit_async(const char *ph, uint32_t id, uint64_t ts, const char *name)
+{
+    emit_event(ph, TRACE_PID_MESSAGE_BUS, 0, ts, name, "latency");
+    fprintf(out, ",\"id\":%u}", id);
+}
+
+static void emit_name(const char *kind, int pid, int tid, const char *name)
+{
+    emit_begin();
+    fprintf(out, "{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"args\":{\"name\":\"%s\"}}", pid, tid, kind, name);
+}
+
+static void fiber_name(int fiber, char *name, int len)
+{
+    if (fiber == CODAL_TRACE_FIBER_NONE)
+        snprintf(name, len, "startup");
+    else if (fiber == CODAL_TRACE_FIBER_IRQ)
+        snprintf(name, len, "interrupt");
+    else
+        snprintf(name, len, "fiber %d", fiber);
+}
+
+/**
+  * Reads a dump of codalTraceStore, returning its entries in the order they were recorded.
+  */
+static bool read_trace(const char *path, std::vector<CodalTraceEntry> &entries)
+{
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    CodalTraceStore header;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != CODAL_TRACE_MAGIC || header.entrySize != sizeof(CodalTraceEntry))
+    {
+        fprintf(stderr, "%s: not a codal trace dump\n", path);
+        fclose(f);
+        return false;
+    }
+
+    std::vector<CodalTraceEntry> ring(header.size);
+
+    if (header.size == 0 || fread(&ring[0], sizeof(CodalTraceEntry), header.size, f) != header.size)
+    {
+        fprintf(stderr, "%s: truncated trace dump\n", path);
+        fclose(f);
+        return false;
+    }
+
+    fclose(f);
+
+    // Once the ring has wrapped, the oldest entry is the next to be overwritten.
+    uint32_t count = header.ptr < header.size ? header.ptr : header.size;
+    uint32_t start = header.ptr < header.size ? 0 : header.ptr % header.size;
+
+    for (uint32_t i = 0; i < count; i++)
+        entries.push_back(ring[(start + i) % header.size]);
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s trace.bin [trace.json]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<CodalTraceEntry> entries;
+
+    if (!read_trace(argv[1], entries))
+        return 1;
+
+    out = argc > 2 ? fopen(argv[2], "w") : stdout;
+
+    if (out == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    std::map<uint32_t, std::deque<uint64_t> > queued;   // Times at which events still waiting in the queue were queued.
+    std::map<uint32_t, TraceDelivery> delivering;       // Events whose handlers may still be running.
+    std::map<int, uint64_t> running;                    // The time each fiber was last scheduled in.
+    bool fibers[256] = { false };
+    int handlers[256] = { 0 };                          // The number of handlers running on each fiber.
+    uint32_t spans = 0;
+
+    uint64_t epoch = 0;
+    uint32_t last = entries.empty() ? 0 : entries[0].timestamp;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        CodalTraceEntry &e = entries[i];
+        char name[32];
+
+        // Timestamps are 32 bit microsecond counts, so wrap roughly every 71 minutes.
+        if (e.timestamp < last && last - e.timestamp > 0x80000000)
+            epoch += 0x100000000ULL;
+
+        last = e.timestamp;
+
+        uint64_t ts = epoch + e.timestamp;
+        uint32_t key = ((uint32_t)e.source << 16) | e.value;
+
+        snprintf(name, sizeof(name), "%d:%d", e.source, e.value);
+        fibers[e.fiber] = true;
+
+        switch (e.phase)
+        {
+            case CODAL_TRACE_QUEUED:
+                queued[key].push_back(ts);
+                emit_instant(e.fiber, ts, "queued");
+                break;
+
+            case CODAL_TRACE_MERGED:
+                emit_instant(e.fiber, ts, "merged");
+                break;
+
+            case CODAL_TRACE_DROPPED:
+                // An event dropped from the queue will never be dispatched.
+                if (e.arg && !queued[key].empty())
+                    queued[key].pop_front();
+
+                emit_instant(e.fiber, ts, "dropped");
+                break;
+
+            case CODAL_TRACE_DISPATCHED:
+            {
+                std::map<uint32_t, TraceDelivery>::iterator d = delivering.find(key);
+
+                if (d != delivering.end())
+                    emit_async("e", d->second.id, d->second.end, name);
+
+                // Events raised before the trace began may be dispatched without having been seen queued.
+                uint64_t start = ts;
+
+                if (!queued[key].empty())
+                {
+                    start = queued[key].front();
+                    queued[key].pop_front();
+                }
+
+                TraceDelivery delivery = { ++spans, ts };
+                delivering[key] = delivery;
+
+                emit_async("b", delivery.id, start, name);
+                emit_async("n", delivery.id, ts, "dispatched");
+                break;
+            }
+
+            case CODAL_TRACE_HANDLER:
+                handlers[e.fiber]++;
+                emit_event("B", TRACE_PID_MESSAGE_BUS, e.fiber, ts, name, "handler");
+                fprintf(out, "}");
+                break;
+
+            case CODAL_TRACE_HANDLED:
+            {
+                std::map<uint32_t, TraceDelivery>::iterator d = delivering.find(key);
+
+                if (d != delivering.end())
+                    d->second.end = ts;
+
+                // Ignore handlers that were already running when the trace began.
+                if (handlers[e.fiber] == 0)
+                    break;
+
+                handlers[e.fiber]--;
+                emit_event("E", TRACE_PID_MESSAGE_BUS, e.fiber, ts, name, "handler");
+                fprintf(out, "}");
+                break;
+            }
+
+            case CODAL_TRACE_SWITCH:
+            {
+                std::map<int, uint64_t>::iterator r = running.find(e.arg);
+
+                // The fiber scheduled out has been running since it was last scheduled in.
+                if (r != running.end())
+                {
+                    fiber_name(e.arg, name, sizeof(name));
+                    emit_event("X", TRACE_PID_SCHEDULER, e.arg, r->second, name, "scheduler");
+                    fprintf(out, ",\"dur\":%llu}", (unsigned long long)(ts - r->second));
+                    running.erase(r);
+                }
+
+                if (e.arg < 256)
+                    fibers[e.arg] = true;
+
+                running[e.fiber] = ts;
+                break;
+            }
+        }
+    }
+
+    for (std::map<uint32_t, TraceDelivery>::iterator d = delivering.begin(); d != delivering.end(); d++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%d:%d", d->first >> 16, d->first & 0xFFFF);
+        emit_async("e", d->second.id, d->second.end, name);
+    }
+
+    emit_name("process_name", TRACE_PID_MESSAGE_BUS, 0, "MessageBus");
+    emit_name("process_name", TRACE_PID_SCHEDULER, 0, "Scheduler");
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (fibers[i])
+        {
+            char name[32];
+            fiber_name(i, name, sizeof(name));
+            emit_name("thread_name", TRACE_PID_MESSAGE_BUS, i, name);
+            emit_name("thread_name", TRACE_PID_SCHEDULER, i, name);
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "%u entries, %u events dispatched\n", (unsigned)entries.size(), spans);
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_ARENA_H
+#define CODAL_ARENA_H
+
+#include "CodalConfig.h"
+#include "CodalFiber.h"
+
+namespace codal
+{
+    /**
+      * A region of memory for short lived scratch allocations, such as the buffers passed between stream stages
+      * within a single callback.
+      *
+      * Memory is handed out by advancing a pointer, so allocation is O(1) and never fragments the heap. Memory is
+      * not released individually, but all at once (also in O(1)) when the ArenaScope it was allocated within ends.
+      */
+    class ArenaScope;
+
+    class CodalArena
+    {
+        friend class ArenaScope;
+
+        uint8_t         *storage;           // The memory of this arena.
+        uint32_t        size;               // The size of the arena, in bytes.
+        uint32_t        used;               // The number of bytes currently allocated.
+        uint32_t        peak;               // The most bytes allocated at any one time.
+        uint16_t        fallbacks;          // The number of allocations refused, as the arena was full.
+        bool            owned;              // Whether the storage was allocated from the heap by this arena.
+        ArenaScope      *scope;             // The innermost scope on this arena, or NULL if there is none.
+        CodalArena      *next;              // The next arena in the list of all arenas.
+
+        static CodalArena *arenas;          // All arenas.
+
+        public:
+
+        /**
+          * Constructor.
+          * Creates an arena of the given size, in fast memory if available.
+          *
+          * @param size The size of the arena, in bytes.
+          */
+        CodalArena(uint32_t size);
+
+        /**
+          * Constructor.
+          * Creates an arena in the given memory, which must remain valid for the lifetime of the arena.
+          *
+          * @param storage The memory to use, aligned to a processor word.
+          * @param size The size of the memory, in bytes.
+          */
+        CodalArena(void *storage, uint32_t size);
+
+        /**
+          * Destructor.
+          */
+        ~CodalArena();
+
+        /**
+          * Allocates memory from this arena. The memory remains valid until the innermost ArenaScope on this arena ends.
+          *
+          * @param size The amount of memory, in bytes, to allocate.
+          * @param refCounted true if the memory will hold a RefCounted object. The arena then checks that the object
+          * is no longer referenced when the scope ends.
+          *
+          * @return A pointer to the memory, or NULL if the arena is full (or has no active scope).
+          */
+        void *allocate(uint32_t size, bool refCounted = false);
+
+        /**
+          * Determines if the given memory is held within this arena.
+          */
+        bool contains(void *p)
+        {
+            return (uint8_t *)p >= storage && (uint8_t *)p < storage + size;
+        }
+
+        /**
+          * Determines the number of bytes currently allocated from this arena.
+          */
+        uint32_t getUsed()
+        {
+            return used;
+        }
+
+        /**
+          * Determines the most bytes ever allocated from this arena at one time, to help size it.
+          */
+        uint32_t getPeak()
+        {
+            return peak;
+        }
+
+        /**
+          * Determines the number of allocations refused, as the arena was full.
+          */
+        uint16_t getFallbacks()
+        {
+            return fallbacks;
+        }
+
+        /**
+          * Records that a RefCounted object is no longer referenced. Called by RefCounted::decr() for every object,
+          * so that objects in an arena are not passed to the heap. The object is charged to the scope it was
+          * allocated within, which is the scope whose part of the arena holds it.
+          *
+          * @param p The object.
+          *
+          * @return true if the object is held in an arena, false otherwise.
+          */
+        static bool release(void *p);
+    };
+
+    /**
+      * Marks the lifetime of memory allocated from a CodalArena. All memory allocated from the arena while the scope
+      * is active is released when it ends. Scopes are normally declared on the stack, around the processing of a
+      * single callback or request, and may be nested:
+      *
+      * @code
+      * static CodalArena scratch(2048);
+      *
+      * int AudioOutput::pullRequest()
+      * {
+      *     ArenaScope scope(scratch);
+      *     ManagedBuffer b = upstream.pull();  // Stream stages allocate their buffers from scratch.
+      *     play(b);
+      *     return DEVICE_OK;
+      * }                                       // All of the buffers are released here.
+      * @endcode
+      *
+      * The innermost scope on the current fiber is available through ArenaScope::current(), so that code
+      * (such as the stream stages) can use an arena without being passed one. No object allocated within a
+      * scope may be referenced after the scope ends: if a RefCounted object is, the device will panic with
+      * DEVICE_HEAP_ERROR. Scopes on the same arena must also end in the reverse order to that they began, so a
+      * fiber should not block within a scope on an arena shared with other fibers.
+      */
+    class ArenaScope
+    {
+        friend class CodalArena;
+
+        CodalArena      &arena;             // The arena this scope allocates from.
+        uint32_t        mark;               // The bytes allocated from the arena when this scope began.
+        uint16_t        live;               // The RefCounted objects allocated in this scope that are still referenced.
+        Fiber           *fiber;             // The fiber this scope is active on.
+        ArenaScope      *outer;             // The scope on the same arena that this scope is nested within.
+        ArenaScope      *next;              // The next scope in the list of active scopes, innermost first.
+
+        static ArenaScope *active;          // All active scopes, innermost first.
+
+        public:
+
+        /**
+          * Constructor.
+          * Begins a scope on the given arena, making it the current arena for this fiber.
+          *
+          * @param arena The arena to allocate from.
+          */
+        ArenaScope(CodalArena &arena);
+
+        /**
+          * Destructor.
+          * Releases all memory allocated from the arena since this scope began.
+          */
+        ~ArenaScope();
+
+        /**
+          * Determines the arena of the innermost scope active on the current fiber.
+          *
+          * @return The arena, or NULL if there is no scope active on this fiber.
+          */
+        static CodalArena *current();
+
+        /**
+          * Determines the number of RefCounted objects allocated within this scope (and not a scope nested within it)
+          * that are still referenced.
+          */
+        uint16_t getLive()
+        {
+            return live;
+        }
+    };
+}
+
+#endif
@@ -173,6 +173,13 @@ namespace codal
 
         static CodalComponent* components[DEVICE_COMPONENT_COUNT];
 
+        /**
+          * Determines if any component has requested a periodic callback (DEVICE_COMPONENT_STATUS_SYSTEM_TICK).
+          *
+          * @return true if at least one component requires a system tick, false otherwise.
+          */
+        static bool systemTickRequired();
+
         uint16_t id;                    // Event Bus ID of this component
         uint16_t status;                // Component defined state.
 
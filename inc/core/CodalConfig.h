@@ -67,6 +67,92 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_MAXIMUM_HEAPS                  1
 #endif
 
+//
+// The properties of heap regions created without any given (including the default heap), used to place
+// allocations made with device_malloc_hint(). See DEVICE_HEAP_FAST, DEVICE_HEAP_LARGE and DEVICE_HEAP_DMA.
+//
+#ifndef DEVICE_HEAP_DEFAULT_FLAGS
+#define DEVICE_HEAP_DEFAULT_FLAGS             DEVICE_HEAP_DMA
+#endif
+
+//
+// The heap allocation hint used for fiber stacks, which are used on every context switch.
+//
+#ifndef CODAL_FIBER_STACK_HEAP_HINT
+#define CODAL_FIBER_STACK_HEAP_HINT           DEVICE_HEAP_FAST
+#endif
+
+//
+// The heap allocation hint used for ManagedBuffer payloads, unless one is given when the buffer is created.
+// No hint by default, as DEVICE_HEAP_DMA is a requirement: buffers passed to DMA controllers (such as audio
+// output) request it explicitly, so that other buffers may still use heaps that are not DMA capable.
+//
+#ifndef CODAL_MANAGED_BUFFER_HEAP_HINT
+#define CODAL_MANAGED_BUFFER_HEAP_HINT        0
+#endif
+
+//
+// ManagedBuffers of at least this many bytes are also hinted as DEVICE_HEAP_LARGE, keeping bulk data out of
+// any fast heap region. Set to '0' to disable.
+//
+#ifndef CODAL_MANAGED_BUFFER_LARGE_SIZE
+#define CODAL_MANAGED_BUFFER_LARGE_SIZE       512
+#endif
+
+//
+// Selects the allocation policy used within each heap region. By default, a first fit policy is used, which
+// has no per heap overhead, but whose allocation time grows with the number of blocks in the heap.
+// Set '1' to use a two level segregated fit (TLSF) policy instead, whose allocation and release take constant time.
+// n.b. TLSF reserves an index of free lists at the start of each heap region (approx 400 bytes with the defaults below).
+// n.b. TLSF takes the first block from a list of larger blocks rather than the lowest addressed block that fits, so
+// under heavy churn of mixed sizes it fragments the heap more than first fit does, and may fail more allocations
+// once the heap is nearly full. Prefer first fit where heap headroom matters more than bounded allocation time.
+//
+#ifndef CODAL_HEAP_TLSF
+#define CODAL_HEAP_TLSF                       0
+#endif
+
+//
+// The number of second level free lists per power of two under the TLSF policy, as a power of two.
+// Higher values reduce fragmentation, at the cost of a larger index.
+//
+#ifndef CODAL_HEAP_TLSF_SL_LOG2
+#define CODAL_HEAP_TLSF_SL_LOG2               3
+#endif
+
+//
+// The largest block size held in its own TLSF free list, as a power of two.
+// Larger blocks share the last list, which is searched in turn.
+//
+#ifndef CODAL_HEAP_TLSF_FL_INDEX_MAX
+#define CODAL_HEAP_TLSF_FL_INDEX_MAX          16
+#endif
+
+//
+// Maintains statistics of heap usage as memory is allocated and released, available through device_heap_statistics().
+// If DEVICE_TAG is also enabled, the memory held by RefCounted objects is recorded by tag.
+// Set '1' to enable.
+//
+#ifndef CODAL_HEAP_STATS
+#define CODAL_HEAP_STATS                      0
+#endif
+
+//
+// The number of block size classes recorded by the heap statistics. Each class is twice the size of the last,
+// starting at 16 bytes.
+//
+#ifndef CODAL_HEAP_STATS_SIZE_CLASSES
+#define CODAL_HEAP_STATS_SIZE_CLASSES         8
+#endif
+
+//
+// The number of RefCounted tags recorded separately by the heap statistics. Higher tags (such as REF_TAG_USER)
+// are recorded together in the last entry.
+//
+#ifndef CODAL_HEAP_STATS_TAGS
+#define CODAL_HEAP_STATS_TAGS                 5
+#endif
+
 // If enabled, RefCounted objects include a constant tag at the beginning.
 // Set '1' to enable.
 #ifndef DEVICE_TAG
@@ -100,6 +186,68 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_FIBER_USER_DATA                     1
 #endif
 
+// Enable this to run the scheduler without a periodic tick. Instead, a single timer event is scheduled
+// for the next time the scheduler has work to do: the wake up time of the first sleeping fiber, or the next
+// SCHEDULER_TICK_PERIOD_US system tick, if any component has requested one (DEVICE_COMPONENT_STATUS_SYSTEM_TICK).
+// Set '1' to enable.
+#ifndef CODAL_SCHEDULER_TICKLESS
+#define CODAL_SCHEDULER_TICKLESS                   0
+#endif
+
+// Number of hash buckets used to index fibers blocked in fiber_wait_for_event() by event id and value,
+// so that an event only needs to be checked against the fibers waiting for it. Fibers waiting on
+// DEVICE_ID_ANY or DEVICE_EVT_ANY are held in one additional bucket, which is checked for every event.
+// Set to '0' to hold all waiting fibers in a single list.
+#ifndef CODAL_FIBER_WAIT_QUEUE_BUCKETS
+#define CODAL_FIBER_WAIT_QUEUE_BUCKETS             8
+#endif
+
+// The number of fiber priority levels (up to 32). Runnable fibers of a higher priority are always
+// scheduled before those of a lower priority, and fibers of equal priority are scheduled round robin.
+#ifndef CODAL_FIBER_PRIORITY_LEVELS
+#define CODAL_FIBER_PRIORITY_LEVELS                4
+#endif
+
+// Enable this to protect low priority fibers from starvation. A runnable fiber passed over this many
+// times in favour of higher priority fibers is promoted one priority level, until it has next run.
+// Set to '0' to disable.
+#ifndef CODAL_FIBER_PRIORITY_AGING
+#define CODAL_FIBER_PRIORITY_AGING                 0
+#endif
+
+// The number of tasks that may be queued by schedule_task() at each fiber priority level.
+// The worker fiber that runs the tasks is only created when the first task is queued.
+// Set to '0' to disable the task queue, and save the RAM used by its rings.
+#ifndef CODAL_TASK_QUEUE_SIZE
+#define CODAL_TASK_QUEUE_SIZE                      0
+#endif
+
+// Enable this to record scheduler statistics for each fiber: the number of times it has been scheduled,
+// its total run time and run queue wait time, and its deepest stack. See fiber_get_stats() and fiber_dump_stats().
+// Set to '0' to compile this out entirely.
+#ifndef CODAL_FIBER_STATS
+#define CODAL_FIBER_STATS                          0
+#endif
+
+// Enable this to give each fiber a fixed, dedicated stack, rather than paging fibers in and out of
+// the system stack. Context switches then only exchange registers and stack pointer, at the cost of
+// reserving a full stack for every fiber.
+// Set '1' to enable.
+#ifndef CODAL_FIBER_DEDICATED_STACKS
+#define CODAL_FIBER_DEDICATED_STACKS               0
+#endif
+
+// Size (in bytes) of a dedicated fiber stack, used when no size is given to create_fiber().
+#ifndef CODAL_FIBER_STACK_SIZE
+#define CODAL_FIBER_STACK_SIZE                     2048
+#endif
+
+// Value held in the lowest word of every dedicated fiber stack, and checked each time the fiber is
+// scheduled out. If it has changed, the fiber has overflowed its stack.
+#ifndef CODAL_FIBER_STACK_GUARD
+#define CODAL_FIBER_STACK_GUARD                    0xC0DAF1BE
+#endif
+
 //
 // Message Bus:
 // Default behaviour for event handlers, if not specified in the listen() call
@@ -117,11 +265,118 @@ DEALINGS IN THE SOFTWARE.
 //
 // Maximum event queue depth. If a queue exceeds this depth, further events will be dropped.
 // Used to prevent message queues growing uncontrollably due to badly behaved user code and causing panic conditions.
+// Queues are fixed size rings of this many events (at most 255), held in the MessageBus and allocated once per
+// MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY listener the first time it is busy.
 //
 #ifndef MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH
 #define MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH    10
 #endif
 
+//
+// The number of Listeners, MemberFunctionCallbacks and Listener event queues held in fixed size object pools
+// (see CodalSlab.h). These are small, long lived objects allocated as handlers are registered, so pooling them
+// makes their allocation O(1) and keeps them from fragmenting the heap. Once a pool is exhausted, further objects
+// are allocated from the heap. The pools are held in static RAM, so they are disabled by default (all such objects
+// are allocated from the heap). Targets with RAM to spare may enable them, e.g. with sizes of 16, 8 and 2.
+//
+#ifndef CODAL_LISTENER_SLAB_SIZE
+#define CODAL_LISTENER_SLAB_SIZE                0
+#endif
+
+#ifndef CODAL_CALLBACK_SLAB_SIZE
+#define CODAL_CALLBACK_SLAB_SIZE                0
+#endif
+
+#ifndef CODAL_LISTENER_QUEUE_SLAB_SIZE
+#define CODAL_LISTENER_QUEUE_SLAB_SIZE          0
+#endif
+
+//
+// Number of hash buckets used to index MessageBus listeners by source id, so that an event is only checked
+// against the listeners that could match it. Listeners for DEVICE_ID_ANY are held in one additional bucket,
+// which is checked for every event. Urgent and standard listeners are indexed separately.
+// Set to '0' to hold all listeners in a single list.
+//
+#ifndef MESSAGE_BUS_LISTENER_BUCKETS
+#define MESSAGE_BUS_LISTENER_BUCKETS            16
+#endif
+
+//
+// The number of StaticListener tables that may be registered with each MessageBus (see EventModel::addStaticListeners()).
+// The core runtime registers three: the MessageBus itself, the scheduler and CodalComponent.
+//
+#ifndef MESSAGE_BUS_STATIC_TABLES
+#define MESSAGE_BUS_STATIC_TABLES               4
+#endif
+
+//
+// The number of event sources that may have coalescing enabled on the MessageBus (see MessageBus::setCoalescing()).
+// A queued event from such a source absorbs any identical event raised before it is delivered.
+//
+#ifndef MESSAGE_BUS_COALESCE_SOURCES
+#define MESSAGE_BUS_COALESCE_SOURCES            4
+#endif
+
+//
+// What the MessageBus does with an event that needs to be queued when its queue is full.
+//
+// Permissable values are:
+//   MESSAGE_BUS_OVERFLOW_DROP_NEWEST   - the new event is dropped.
+//   MESSAGE_BUS_OVERFLOW_DROP_OLDEST   - the oldest queued event is dropped to make space.
+//   MESSAGE_BUS_OVERFLOW_BLOCK         - the sender waits until the idle fiber has taken an event from the queue, if it may
+//                                        block (see fiber_can_block()). Otherwise, the new event is dropped. Events sent from
+//                                        interrupt context, or by the idle fiber outside of fork on block, are always dropped,
+//                                        as are all events on targets that do not implement target_in_irq() (other than Cortex-M).
+//   MESSAGE_BUS_OVERFLOW_GROW          - the queue grows, up to MESSAGE_BUS_QUEUE_GROW_LIMIT events.
+//                                        Beyond that, the new event is dropped.
+//
+#ifndef MESSAGE_BUS_OVERFLOW_POLICY
+#define MESSAGE_BUS_OVERFLOW_POLICY             MESSAGE_BUS_OVERFLOW_DROP_NEWEST
+#endif
+
+//
+// The largest number of events the MessageBus queue may grow to hold, with the MESSAGE_BUS_OVERFLOW_GROW policy.
+//
+#ifndef MESSAGE_BUS_QUEUE_GROW_LIMIT
+#define MESSAGE_BUS_QUEUE_GROW_LIMIT            (MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH * 4)
+#endif
+
+//
+// The number of event sources for which the MessageBus records dropped events separately (see MessageBus::getStatistics()).
+//
+#ifndef MESSAGE_BUS_STATS_DROP_SOURCES
+#define MESSAGE_BUS_STATS_DROP_SOURCES          4
+#endif
+
+//
+// The number of worker fibers used by the MessageBus to run event handlers that may block.
+// If non-zero, such handlers are queued and run by this fixed pool of fibers, so that the number of fibers
+// (and their stacks) needed during a burst of events is bounded. While the handler queue is full, the MessageBus
+// stops taking further events from its own queue.
+// Set to '0' to run each handler with invoke(), creating a new fiber whenever a handler blocks.
+//
+#ifndef MESSAGE_BUS_HANDLER_FIBERS
+#define MESSAGE_BUS_HANDLER_FIBERS              0
+#endif
+
+//
+// The number of event handler calls that may wait for a MessageBus worker fiber (see MESSAGE_BUS_HANDLER_FIBERS).
+//
+#ifndef MESSAGE_BUS_HANDLER_QUEUE_SIZE
+#define MESSAGE_BUS_HANDLER_QUEUE_SIZE          8
+#endif
+
+//
+// The number of events that may be held by each EventRing, used by drivers to raise events from interrupt context.
+// Events pushed onto an EventRing are delivered by the MessageBus when the scheduler is next idle, rather than
+// in the interrupt handler, which keeps interrupt latency short and bounded. The cost is that delivery waits until
+// no fiber is runnable, which delays any fiber blocked on such an event while other fibers are busy.
+// Set to '0' to deliver these events immediately from the interrupt handler, as a plain Event would be.
+//
+#ifndef CODAL_EVENT_RING_SIZE
+#define CODAL_EVENT_RING_SIZE                   0
+#endif
+
 //Configures the default serial mode used by serial read and send calls.
 #ifndef DEVICE_DEFAULT_SERIAL_MODE
 #define DEVICE_DEFAULT_SERIAL_MODE            SYNC_SLEEP
@@ -178,6 +433,14 @@ DEALINGS IN THE SOFTWARE.
   #endif
 #endif
 
+// When non-zero, the MessageBus and scheduler record a compact binary trace of events and context switches
+// to an in-memory ring of this many entries (see CodalTrace.h). It can be dumped from GDB
+// (with 'dump binary value trace.bin codalTraceStore'), and converted with the host codal-trace-to-chrome tool.
+// Each entry takes 12 bytes. Set to 0 to disable.
+#ifndef CODAL_TRACE_BUFFER_SIZE
+#define CODAL_TRACE_BUFFER_SIZE                 0
+#endif
+
 #ifndef CODAL_DEBUG
 #define CODAL_DEBUG                           CODAL_DEBUG_DISABLED
 #endif
@@ -45,12 +45,22 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_SCHEDULER_RUNNING            0x01
 #define DEVICE_SCHEDULER_IDLE               0x02
 #define DEVICE_SCHEDULER_DEEPSLEEP          0x04
+#define DEVICE_SCHEDULER_TICK_PENDING       0x08
+#define DEVICE_SCHEDULER_COMPONENT_TICK     0x10
 
 // Fiber Flags
 #define DEVICE_FIBER_FLAG_FOB               0x01
 #define DEVICE_FIBER_FLAG_PARENT            0x02
 #define DEVICE_FIBER_FLAG_CHILD             0x04
 #define DEVICE_FIBER_FLAG_DO_NOT_PAGE       0x08
+#define DEVICE_FIBER_FLAG_TIMED_WAIT        0x10
+#define DEVICE_FIBER_FLAG_TIMED_OUT         0x20
+
+// Fiber Priorities
+#define DEVICE_FIBER_PRIORITY_LOW           0
+#define DEVICE_FIBER_PRIORITY_NORMAL        1
+#define DEVICE_FIBER_PRIORITY_HIGH          2
+#define DEVICE_FIBER_PRIORITY_REALTIME      3
 
 #define DEVICE_SCHEDULER_EVT_TICK           1
 #define DEVICE_SCHEDULER_EVT_IDLE           2
@@ -60,6 +70,22 @@ DEALINGS IN THE SOFTWARE.
 
 namespace codal
 {
+    /**
+      * Scheduler statistics for a single Fiber, recorded if CODAL_FIBER_STATS is enabled.
+      * Times are in microseconds.
+      */
+    struct FiberStats
+    {
+        uint32_t switches;                  // The number of times this fiber has been scheduled in.
+        CODAL_TIMESTAMP runTime;            // The total time this fiber has spent running.
+        CODAL_TIMESTAMP waitTime;           // The total time this fiber has spent runnable, waiting to be scheduled in.
+        uint32_t maxStackDepth;             // The deepest stack seen when this fiber was scheduled out, in bytes.
+                                            // With CODAL_FIBER_DEDICATED_STACKS, not recorded for the fiber on the system stack.
+        CODAL_TIMESTAMP timestamp;          // The time this fiber was last scheduled in, or became runnable.
+    };
+
+    class FiberLock;
+
     /**
       * Representation of a single Fiber
       */
@@ -68,14 +94,35 @@ namespace codal
         void* tcb;                          // Thread context when last scheduled out.
         PROCESSOR_WORD_TYPE stack_bottom;   // The start address of this Fiber's stack. The stack is heap allocated, and full descending.
         PROCESSOR_WORD_TYPE stack_top;      // The end address of this Fiber's stack.
+                                            // With CODAL_FIBER_DEDICATED_STACKS, this is the stack the Fiber executes on.
         uint32_t context;                   // Context specific information.
         uint32_t flags;                     // Information about this fiber.
+        uint8_t priority;                   // The priority level of this fiber. See DEVICE_FIBER_PRIORITY_*.
+        #if CODAL_TRACE_BUFFER_SIZE > 0
+        uint8_t trace_id;                   // Identifies this fiber in trace entries. Retained as the fiber is reused.
+        #endif
+        uint32_t timeout;                   // The time (in milliseconds) at which a timed wait expires.
+        Fiber *tnext;                       // The next fiber on the list of fibers in a timed wait.
+        FiberLock *lock;                    // The FiberLock this fiber is blocked on in a timed wait, or NULL if it waits for an event.
         Fiber **queue;                      // The queue this fiber is stored on.
-        Fiber *qnext, *qprev;               // Position of this Fiber on the run queue.
+        Fiber *qnext, *qprev;               // Position of this Fiber on the run queue. qprev of the head of a queue refers to its tail.
         Fiber *next;                        // Position of this Fiber on the global list of fibers.
         #if CONFIG_ENABLED(DEVICE_FIBER_USER_DATA)
         void *user_data;
         #endif
+        #if CONFIG_ENABLED(CODAL_FIBER_STATS)
+        FiberStats stats;                   // Scheduler statistics for this fiber.
+        #endif
+    };
+
+    /**
+      * An event to wait for, as used by fiber_wait_for_any().
+      * DEVICE_ID_ANY and DEVICE_EVT_ANY may be used as wildcards.
+      */
+    struct EventFilter
+    {
+        uint16_t id;                        // The ID field of the event to wait for (e.g. DEVICE_ID_BUTTON_A)
+        uint16_t value;                     // The value of the event to wait for (e.g. DEVICE_BUTTON_EVT_CLICK)
     };
 
     enum FiberLockMode {
@@ -102,6 +149,15 @@ namespace codal
       */
     int fiber_scheduler_running();
 
+    /**
+      * Determines if the calling code may block, i.e. it is running on a fiber under the fiber scheduler,
+      * other than the idle fiber, and not from an interrupt handler. Code running in invoke() may block,
+      * as a fiber will be created for it if it does.
+      *
+      * @return 1 if the caller may block, 0 otherwise.
+      */
+    int fiber_can_block();
+
     /**
      * Provides a list of all active fibers.
      * 
@@ -109,6 +165,36 @@ namespace codal
      */
     Fiber* get_fiber_list();
 
+    /**
+     * Iterates over the list of all active fibers.
+     *
+     * @param f The previous fiber, or NULL to start at the head of the list.
+     *
+     * @return The next active fiber, or NULL at the end of the list.
+     *
+     * @code
+     * for (Fiber *f = fiber_list_next(NULL); f; f = fiber_list_next(f))
+     *     fiber_get_stats(f, &stats);
+     * @endcode
+     */
+    Fiber* fiber_list_next(Fiber *f);
+
+    /**
+     * Provides the scheduler statistics of the given fiber, if CODAL_FIBER_STATS is enabled.
+     *
+     * @param f The fiber to query.
+     *
+     * @param stats Set to a snapshot of the fiber's statistics.
+     *
+     * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, or DEVICE_NOT_SUPPORTED if CODAL_FIBER_STATS is disabled.
+     */
+    int fiber_get_stats(Fiber *f, FiberStats *stats);
+
+    /**
+     * Writes the scheduler statistics of every active fiber to DMESG, if CODAL_FIBER_STATS is enabled.
+     */
+    void fiber_dump_stats();
+
     /**
       * Exit point for all fibers.
       *
@@ -153,9 +239,14 @@ namespace codal
       * @param completion_fn The function called when the thread completes execution of entry_fn.
       *                      Defaults to release_fiber.
       *
+      * @param stack_size The size of the new Fiber's stack in bytes, if CODAL_FIBER_DEDICATED_STACKS is enabled.
+      *                   Defaults to CODAL_FIBER_STACK_SIZE. Ignored if fibers share the system stack.
+      *
+      * @param priority The priority of the new Fiber. Defaults to DEVICE_FIBER_PRIORITY_NORMAL.
+      *
       * @return The new Fiber, or NULL if the operation could not be completed.
       */
-    Fiber *create_fiber(void (*entry_fn)(void), void (*completion_fn)(void) = release_fiber);
+    Fiber *create_fiber(void (*entry_fn)(void), void (*completion_fn)(void) = release_fiber, uint32_t stack_size = 0, int priority = DEVICE_FIBER_PRIORITY_NORMAL);
 
 
     /**
@@ -168,9 +259,29 @@ namespace codal
       * @param completion_fn The function called when the thread completes execution of entry_fn.
       *                      Defaults to release_fiber.
       *
+      * @param stack_size The size of the new Fiber's stack in bytes, if CODAL_FIBER_DEDICATED_STACKS is enabled.
+      *                   Defaults to CODAL_FIBER_STACK_SIZE. Ignored if fibers share the system stack.
+      *
+      * @param priority The priority of the new Fiber. Defaults to DEVICE_FIBER_PRIORITY_NORMAL.
+      *
       * @return The new Fiber, or NULL if the operation could not be completed.
       */
-    Fiber *create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *) = release_fiber);
+    Fiber *create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *) = release_fiber, uint32_t stack_size = 0, int priority = DEVICE_FIBER_PRIORITY_NORMAL);
+
+    /**
+      * Changes the priority of the given fiber.
+      *
+      * Runnable fibers of a higher priority are always scheduled before those of a lower priority.
+      * Fibers of equal priority are scheduled round robin. The change takes effect the next time the scheduler runs.
+      *
+      * @param f The fiber to change. Use currentFiber for the calling fiber.
+      *
+      * @param priority The new priority, typically one of DEVICE_FIBER_PRIORITY_*.
+      *                 Priorities above CODAL_FIBER_PRIORITY_LEVELS - 1 are treated as the highest level.
+      *
+      * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER.
+      */
+    int fiber_set_priority(Fiber *f, int priority);
 
 
     /**
@@ -200,6 +311,9 @@ namespace codal
       * The timer callback, called from interrupt context once every SYSTEM_TICK_PERIOD_MS milliseconds.
       * This function checks to determine if any fibers blocked on the sleep queue need to be woken up
       * and made runnable.
+      *
+      * If CODAL_SCHEDULER_TICKLESS is enabled, this is instead called only when a sleeping fiber is due to
+      * wake up, or a component system tick is due. Component system ticks are raised from here.
       */
     void scheduler_tick(Event);
 
@@ -223,6 +337,44 @@ namespace codal
       */
     int fiber_wait_for_event(uint16_t id, uint16_t value);
 
+    /**
+      * Blocks the calling thread until the specified event is raised, or the given period of time has elapsed,
+      * whichever happens first.
+      *
+      * @param id The ID field of the event to listen for (e.g. DEVICE_ID_BUTTON_A)
+      *
+      * @param value The value of the event to listen for (e.g. DEVICE_BUTTON_EVT_CLICK)
+      *
+      * @param timeout The maximum period of time to wait, in milliseconds. Set to zero to wait indefinitely.
+      *
+      * @return DEVICE_OK if the event was raised, DEVICE_TIMEOUT if the timeout expired first, or DEVICE_NOT_SUPPORTED
+      *         if the fiber scheduler is not running, or associated with an EventModel.
+      *
+      * @code
+      * if (fiber_wait_for_event_timeout(DEVICE_ID_BUTTON_A, DEVICE_BUTTON_EVT_CLICK, 1000) == DEVICE_TIMEOUT)
+      *     DMESG("no click within a second");
+      * @endcode
+      */
+    int fiber_wait_for_event_timeout(uint16_t id, uint16_t value, uint32_t timeout);
+
+    /**
+      * Blocks the calling thread until any one of the given events is raised.
+      * The calling thread will be immediately descheduled, and woken only by an event matching one of the filters.
+      *
+      * @param filters The events to wait for. The filters are copied, so need not remain valid while the fiber waits.
+      *
+      * @param n The number of filters.
+      *
+      * @return The event that woke the fiber. If the fiber scheduler is not running or associated with an EventModel,
+      *         the parameters are invalid or there is insufficient memory, an event with source DEVICE_ID_ANY is returned immediately.
+      *
+      * @code
+      * EventFilter filters[] = {{DEVICE_ID_RADIO, DEVICE_RADIO_EVT_DATAGRAM}, {DEVICE_ID_BUTTON_A, DEVICE_BUTTON_EVT_CLICK}};
+      * Event evt = fiber_wait_for_any(filters, 2);
+      * @endcode
+      */
+    Event fiber_wait_for_any(const EventFilter *filters, int n);
+
     /**
       * Configures the fiber context for the current fiber to block on an event ID
       * and value, but does not deschedule the fiber.
@@ -282,6 +434,9 @@ namespace codal
       * If the stack allocation is large enough to hold the current system stack, then this function does nothing.
       * Otherwise, the the current allocation of the fiber is freed, and a larger block is allocated.
       *
+      * If CODAL_FIBER_DEDICATED_STACKS is enabled, fiber stacks are fixed in size, and this function instead
+      * verifies the stack guard of the given fiber, and panics with DEVICE_STACK_OVERFLOW if it has been overwritten.
+      *
       * @param f The fiber context to verify.
       *
       * @return The stack depth of the given fiber.
@@ -315,10 +470,7 @@ namespace codal
     /**
       * Utility function to add the currenty running fiber to the given queue.
       *
-      * Perform a simple add at the head, to avoid complexity,
-      *
-      * Queues are normally very short, so maintaining a doubly linked, sorted list typically outweighs the cost of
-      * brute force searching.
+      * Fibers are added at the tail of the queue, in constant time.
       *
       * @param f The fiber to add to the queue
       *
@@ -368,6 +520,8 @@ namespace codal
         FiberLockMode mode;
         Fiber         *queue;
 
+        friend void fiber_lock_timeout(Fiber *f);
+
         public:
 
         /**
@@ -383,6 +537,15 @@ namespace codal
          **/
         void wait();
 
+        /**
+         * Block the calling fiber until the lock is available, or the given period of time has elapsed.
+         *
+         * @param timeout The maximum period of time to wait, in milliseconds. Set to zero to wait indefinitely.
+         *
+         * @return DEVICE_OK if the lock was acquired, or DEVICE_TIMEOUT if the timeout expired first.
+         **/
+        int wait(uint32_t timeout);
+
         /**
          * Release the lock, and signal to one waiting fiber to continue
          */
@@ -53,13 +53,19 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 
 // Flag to indicate that a given block is FREE/USED (top bit of a CPU word)
-#define DEVICE_HEAP_BLOCK_FREE		(1 << (sizeof(PROCESSOR_WORD_TYPE) * 8 - 1))
+#define DEVICE_HEAP_BLOCK_FREE		((PROCESSOR_WORD_TYPE)1 << (sizeof(PROCESSOR_WORD_TYPE) * 8 - 1))
 #define DEVICE_HEAP_BLOCK_SIZE      (sizeof(PROCESSOR_WORD_TYPE))
 
+// Properties of a heap region, and the matching allocation hints for device_malloc_hint().
+#define DEVICE_HEAP_FAST            0x01        // Fast memory, such as tightly coupled SRAM, preferred for frequently used data.
+#define DEVICE_HEAP_LARGE           0x02        // Large (and perhaps slower) memory, preferred for bulk data.
+#define DEVICE_HEAP_DMA             0x04        // Memory accessible by DMA controllers. Unlike the others, this hint is a requirement.
+
 struct HeapDefinition
 {
     PROCESSOR_WORD_TYPE *heap_start;		// Physical address of the start of this heap.
     PROCESSOR_WORD_TYPE *heap_end;		    // Physical address of the end of this heap.
+    uint8_t             flags;              // The properties of this heap (DEVICE_HEAP_FAST, DEVICE_HEAP_LARGE, DEVICE_HEAP_DMA).
 };
 extern PROCESSOR_WORD_TYPE codal_heap_start;
 
@@ -68,18 +74,21 @@ extern PROCESSOR_WORD_TYPE codal_heap_start;
   * After this is called, any future calls to malloc, new, free or delete may use the new heap.
   * The heap allocator will attempt to allocate memory from heaps in the order that they are created.
   * i.e. memory will be allocated from first heap created until it is full, then the second heap, and so on.
+  * Allocations made through device_malloc_hint() first try the heaps whose properties match the hint.
   *
   * @param start The start address of memory to use as a heap region.
   *
   * @param end The end address of memory to use as a heap region.
   *
+  * @param flags The properties of the heap region. Defaults to DEVICE_HEAP_DEFAULT_FLAGS.
+  *
   * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the heap could not be allocated.
   *
   * @note Only code that #includes DeviceHeapAllocator.h will use this heap. This includes all codal device runtime
   * code, and user code targetting the runtime. External code can choose to include this file, or
   * simply use the standard heap.
   */
-int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end);
+int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end, uint8_t flags = DEVICE_HEAP_DEFAULT_FLAGS);
 
 /**
  * Returns the size of a given heap.
@@ -100,6 +109,19 @@ uint32_t device_heap_size(uint8_t heap_index);
   */
 extern "C" void* device_malloc(size_t size);
 
+/**
+  * Attempt to allocate a given amount of memory, preferring heap areas suited to its use.
+  * Heaps with all of the properties hinted are tried first, in the order they were created, followed by the others.
+  * If DEVICE_HEAP_DMA is hinted, only heaps accessible by DMA are used.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  *
+  * @param hint The intended use of the memory (any of DEVICE_HEAP_FAST, DEVICE_HEAP_LARGE, DEVICE_HEAP_DMA).
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
+  */
+extern "C" void* device_malloc_hint(size_t size, uint8_t hint);
+
 /**
   * Release a given area of memory from the heap.
   *
@@ -115,4 +137,142 @@ extern "C" void device_free(void *mem);
   */
 extern "C" void* device_realloc(void* ptr, size_t size);
 
+/**
+  * Counts of the ways in which device_realloc() has satisfied requests.
+  */
+struct HeapReallocStatistics
+{
+    uint32_t    shrunk;         // Requests for the same or less memory, satisfied in place.
+    uint32_t    grown;          // Requests for more memory, satisfied in place by absorbing free memory that follows the block.
+    uint32_t    moved;          // Requests satisfied by allocating a new block, and copying the data.
+};
+
+/**
+  * Determines how often device_realloc() has resized blocks in place, rather than moving them.
+  *
+  * @return The realloc statistics since the device started.
+  */
+const HeapReallocStatistics &device_realloc_statistics();
+
+/**
+  * A snapshot of heap usage, across all heap regions. Sizes are the usable size of each block, in bytes.
+  */
+struct HeapStatistics
+{
+    uint32_t    liveBytes;                                      // Memory currently allocated.
+    uint32_t    peakBytes;                                      // The most memory allocated at any one time.
+    uint32_t    liveBlocks;                                     // Blocks currently allocated.
+    uint32_t    allocations;                                    // Successful allocations since the device started.
+    uint32_t    failures;                                       // Failed allocations since the device started.
+    uint32_t    freeBytes;                                      // Memory currently free.
+    uint32_t    largestFree;                                    // The largest block that could currently be allocated.
+    uint8_t     fragmentation;                                  // The percentage of free memory outside the largest free block.
+    uint32_t    sizeClasses[CODAL_HEAP_STATS_SIZE_CLASSES];     // Blocks currently allocated of up to 16, 32, 64... bytes. The last class holds all larger blocks.
+    uint32_t    tagBytes[CODAL_HEAP_STATS_TAGS];                // Memory currently held by RefCounted objects, by DEVICE_TAG. The last entry holds all higher tags.
+};
+
+/**
+  * Takes a snapshot of heap usage. Counts are maintained as memory is allocated and released, but the free
+  * memory figures require a walk of the free memory in each heap, so this should not be called too often.
+  *
+  * @param stats The statistics to fill in.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if CODAL_HEAP_STATS is disabled.
+  */
+int device_heap_statistics(HeapStatistics &stats);
+
+/**
+  * Records that a block of heap memory is now held by a RefCounted object with the given tag.
+  * Used by REF_COUNTED_INIT, and has no effect on memory outside the device heaps.
+  *
+  * @param mem The memory area, as returned by device_malloc().
+  * @param tag The DEVICE_TAG of the object.
+  */
+void device_heap_tag(void *mem, uint16_t tag);
+
+/**
+  * Records that a block of heap memory is no longer held by a RefCounted object with the given tag.
+  *
+  * @param mem The memory area, as returned by device_malloc().
+  * @param tag The DEVICE_TAG of the object.
+  */
+void device_heap_untag(void *mem, uint16_t tag);
+
+#if CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR) && CONFIG_ENABLED(CODAL_HEAP_STATS)
+#define DEVICE_HEAP_TAG(mem, tag)       device_heap_tag(mem, tag)
+#define DEVICE_HEAP_UNTAG(mem, tag)     device_heap_untag(mem, tag)
+#else
+#define DEVICE_HEAP_TAG(mem, tag)       do {} while (0)
+#define DEVICE_HEAP_UNTAG(mem, tag)     do {} while (0)
+#endif
+
+/**
+  * The allocation policy used within each heap region. Implemented by either the first fit allocator
+  * (CodalHeapFirstFit.cpp), or the two level segregated fit allocator (CodalHeapTLSF.cpp) if CODAL_HEAP_TLSF is enabled.
+  * These are used by device_malloc() and device_free(), and are not normally called directly.
+  */
+
+/**
+  * Initialises the memory of the given heap region as completely free.
+  *
+  * @param heap The heap to initialise.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the region is too small.
+  */
+int device_heap_init(HeapDefinition &heap);
+
+/**
+  * Attempt to allocate a given amount of memory from a given heap area.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  * @param heap The heap to allocate memory from.
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
+  */
+void *device_malloc_in(size_t size, HeapDefinition &heap);
+
+/**
+  * Release a given area of memory to the given heap area, from which it was allocated.
+  *
+  * @param mem The memory area to release.
+  * @param heap The heap the memory was allocated from.
+  */
+void device_free_in(void *mem, HeapDefinition &heap);
+
+/**
+  * Attempt to resize a block allocated from a given heap area, without moving it.
+  *
+  * @param mem The memory area to resize, as returned by device_malloc_in().
+  * @param size The amount of memory, in bytes, now required.
+  * @param heap The heap the memory was allocated from.
+  *
+  * @return DEVICE_OK if the block now holds at least size bytes, or DEVICE_NO_RESOURCES if it cannot be resized in place.
+  */
+int device_resize_in(void *mem, size_t size, HeapDefinition &heap);
+
+/**
+  * Determines the number of bytes that may be used in a block allocated from a heap area.
+  *
+  * @param mem The memory area, as returned by device_malloc_in().
+  *
+  * @return The usable size of the block, which is at least the size requested.
+  */
+size_t device_usable_size(void *mem);
+
+/**
+  * Measures the free memory in a given heap area.
+  *
+  * @param heap The heap to measure.
+  * @param total Set to the total number of bytes free.
+  * @param largest Set to the size of the largest block that could be allocated.
+  */
+void device_heap_free_space_in(HeapDefinition &heap, uint32_t &total, uint32_t &largest);
+
+#if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
+/**
+  * Displays a usage summary about a given heap.
+  */
+void device_heap_print(HeapDefinition &heap);
+#endif
+
 #endif
@@ -38,6 +38,8 @@ DEALINGS IN THE SOFTWARE.
 #define MESSAGE_BUS_LISTENER_DROP_IF_BUSY           0x0020
 #define MESSAGE_BUS_LISTENER_NONBLOCKING            0x0040
 #define MESSAGE_BUS_LISTENER_URGENT                 0x0080
+#define MESSAGE_BUS_LISTENER_BATCH                  0x0100
+#define MESSAGE_BUS_LISTENER_BATCH_PENDING          0x0200
 #define MESSAGE_BUS_LISTENER_DELETING               0x8000
 
 #define MESSAGE_BUS_LISTENER_IMMEDIATE              (MESSAGE_BUS_LISTENER_NONBLOCKING |  MESSAGE_BUS_LISTENER_URGENT)
@@ -54,18 +56,23 @@ namespace codal
         uint16_t        id;             // The ID of the component that this listener is interested in.
         uint16_t        value;          // Value this listener is interested in receiving.
         uint16_t        flags;          // Status and configuration options codes for this listener.
+        uint8_t         evt_queue_head;     // Position in evt_queue of the oldest queued event.
+        uint8_t         evt_queue_length;   // The number of events held in evt_queue.
+        uint8_t         evt_merged;         // The number of events a MessageBus merged into evt (see MessageBus::setCoalescing()).
 
         union
         {
             void (*cb)(Event);
             void (*cb_param)(Event, void *);
+            void (*cb_batch)(Event *, int, void *);
             MemberFunctionCallback *cb_method;
         };
 
         void*           cb_arg;         // Optional argument to be passed to the caller.
 
         Event                 evt;
-        EventQueueItem        *evt_queue;
+        Event                 *evt_queue;   // Ring of MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH events waiting for this listener, allocated on first use,
+                                            // followed by the number of events merged into each.
 
         Listener *next;
 
@@ -104,6 +111,26 @@ namespace codal
           */
         Listener(uint16_t id, uint16_t value, void (*handler)(Event, void *), void* arg, uint16_t flags = EVENT_LISTENER_DEFAULT_FLAGS);
 
+        /**
+          * Constructor.
+          *
+          * Create a new Message Bus Listener that receives events in batches. Events are collected in this
+          * listener's queue, and handed to the handler together once the MessageBus has drained its own queue,
+          * or MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH events have been collected.
+          *
+          * @param id The ID of the component you want to listen to.
+          *
+          * @param value The event value you would like to listen to from that component
+          *
+          * @param handler A function pointer to call with each batch of events, and the number of events in it.
+          *
+          * @param arg A pointer to some data that will be given to the handler.
+          *
+          * @param flags User specified, implementation specific flags, that allow behaviour of this events listener
+          * to be tuned.
+          */
+        Listener(uint16_t id, uint16_t value, void (*handler)(Event *, int, void *), void* arg, uint16_t flags = EVENT_LISTENER_DEFAULT_FLAGS);
+
 
         /**
           * Constructor.
@@ -133,8 +160,52 @@ namespace codal
           * Queues and event up to be processed.
           *
           * @param e The event to queue
+          *
+          * @param merged The number of events merged into e.
+          */
+        void queue(Event e, uint8_t merged = 0);
+
+        /**
+          * Removes the oldest event queued for this listener.
+          *
+          * @param e Updated with the oldest queued event.
+          *
+          * @param merged Updated with the number of events merged into that event.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NO_DATA if no events are queued.
+          */
+        int dequeue(Event &e, uint8_t &merged);
+
+        /**
+          * Allocates Listeners from a fixed size pool (CODAL_LISTENER_SLAB_SIZE), falling back to the heap.
+          */
+        static void *operator new(size_t size);
+
+        /**
+          * Releases a Listener allocated by operator new.
           */
-        void queue(Event e);
+        static void operator delete(void *p);
+    };
+
+    /**
+      * An entry in a table of listeners fixed at compile time, for system components that listen for the
+      * lifetime of the program. Declare tables as constexpr, so that they are held in flash:
+      *
+      * @code
+      * static constexpr StaticListener fooListeners[] = {
+      *     { DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE, foo_idle },
+      * };
+      *
+      * EventModel::defaultEventBus->addStaticListeners(fooListeners, 1, &foo);
+      * @endcode
+      *
+      * Static listeners are always treated as MESSAGE_BUS_LISTENER_IMMEDIATE, and cannot be removed.
+      */
+    struct StaticListener
+    {
+        uint16_t        id;                         // The ID of the component that this listener is interested in.
+        uint16_t        value;                      // Value this listener is interested in receiving.
+        void            (*cb)(Event, void *);       // The handler, given the context the table was registered with.
     };
 
     /**
@@ -162,6 +233,9 @@ namespace codal
         this->cb_arg = NULL;
         this->flags = flags | MESSAGE_BUS_LISTENER_METHOD;
         this->evt_queue = NULL;
+        this->evt_queue_head = 0;
+        this->evt_queue_length = 0;
+        this->evt_merged = 0;
         this->next = NULL;
     }
 }
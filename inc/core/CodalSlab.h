@@ -0,0 +1,85 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_SLAB_H
+#define CODAL_SLAB_H
+
+#include "CodalConfig.h"
+
+// The size of each slot in a slab holding objects of the given size, keeping every slot 8 byte aligned.
+#define CODAL_SLAB_SLOT_SIZE(size)      (((size) + 7) & ~7)
+
+// The number of uint64_t needed to hold a slab of the given number of objects of the given size.
+#define CODAL_SLAB_STORAGE(size, count) ((CODAL_SLAB_SLOT_SIZE(size) * (count) + 7) / 8)
+
+namespace codal
+{
+    /**
+      * A fixed size pool of equally sized objects, for small objects that are allocated often.
+      *
+      * Allocation and release are O(1), and slots are only ever reused for objects of the same size, so
+      * pooled objects never fragment the heap. Once every slot is in use, allocations fall back to the heap.
+      *
+      * A CodalSlab has no constructor, and is statically initialised with its storage, so that it may be
+      * used by the constructors of other statically allocated objects:
+      *
+      * @code
+      * static uint64_t fooStorage[CODAL_SLAB_STORAGE(sizeof(Foo), 8)];
+      * static CodalSlab fooSlab = { fooStorage, CODAL_SLAB_SLOT_SIZE(sizeof(Foo)), 8 };
+      * @endcode
+      */
+    struct CodalSlab
+    {
+        void        *storage;       // The slots of this slab.
+        uint16_t    slotSize;       // The size of each slot, in bytes.
+        uint16_t    count;          // The number of slots.
+        uint16_t    used;           // The number of slots that have ever been handed out. Slots beyond this are untouched.
+        uint16_t    inUse;          // The number of slots currently allocated.
+        uint16_t    fallbacks;      // The number of allocations made from the heap, as the slab was full.
+        void        *freeList;      // Released slots, linked through their first word.
+
+        /**
+          * Allocates memory for an object of the given size, from this slab if possible.
+          *
+          * @param size The size of the object, in bytes.
+          *
+          * @return A pointer to the memory, or NULL if there is no memory available.
+          */
+        void *allocate(size_t size);
+
+        /**
+          * Releases memory allocated by allocate(), returning it to this slab or to the heap.
+          *
+          * @param p The memory to release. May be NULL.
+          */
+        void release(void *p);
+
+        /**
+          * Determines if the given memory is held within this slab.
+          */
+        bool contains(void *p);
+    };
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * A lightweight, run-to-completion task queue for the Device Fiber scheduler.
+  *
+  * Many deferred jobs are tiny, and never block. Rather than give each one a Fiber of its own,
+  * schedule_task() records the job in a preallocated ring, and a single worker fiber runs the jobs in turn,
+  * most urgent first. A job is only given a fiber of its own (through fork on block) if it actually blocks.
+  */
+#ifndef CODAL_TASK_QUEUE_H
+#define CODAL_TASK_QUEUE_H
+
+#include "CodalConfig.h"
+#include "CodalFiber.h"
+
+namespace codal
+{
+    /**
+      * Starts the worker fiber that runs queued tasks.
+      * schedule_task() calls this when the first task is queued, so there is normally no need to call this directly.
+      * Call it during startup if the first task may be queued from interrupt context, or if the target does not
+      * implement target_in_irq() (see codal_target_hal.h), as the worker is then never started on demand.
+      *
+      * @return DEVICE_OK, DEVICE_NOT_SUPPORTED if the fiber scheduler is not running, or DEVICE_NO_RESOURCES
+      *         if the worker fiber could not be created.
+      */
+    int task_queue_init();
+
+    /**
+      * Queues the given function to be run to completion by the task queue worker fiber.
+      *
+      * Tasks of a higher priority run first, and tasks of equal priority run in the order they were queued.
+      * If a task blocks, it continues in a fiber of its own, and the worker moves on to the next task.
+      * This function is safe to call from interrupt context, once the worker fiber has been started.
+      *
+      * @param fn The function to run.
+      *
+      * @param arg An untyped parameter passed to fn.
+      *
+      * @param priority The priority of the task, typically one of DEVICE_FIBER_PRIORITY_*.
+      *
+      * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, DEVICE_NOT_SUPPORTED if the task queue is disabled
+      *         or its worker could not be started,
+      *         or DEVICE_NO_RESOURCES if CODAL_TASK_QUEUE_SIZE tasks of this priority are already queued.
+      */
+    int schedule_task(void (*fn)(void *), void *arg = NULL, int priority = DEVICE_FIBER_PRIORITY_NORMAL);
+
+    /**
+      * Determines the number of tasks queued, but not yet started.
+      *
+      * @return The number of queued tasks.
+      */
+    int task_queue_length();
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_TRACE_H
+#define CODAL_TRACE_H
+
+#include "CodalConfig.h"
+
+// Identifies a dump of the CodalTraceStore.
+#define CODAL_TRACE_MAGIC               0x43545243
+
+// Fiber ids used in trace entries recorded outside of any fiber.
+#define CODAL_TRACE_FIBER_NONE          0           // Recorded before the scheduler was running.
+#define CODAL_TRACE_FIBER_IRQ           255         // Recorded in interrupt context, or wherever target_in_irq() cannot tell.
+
+/**
+  * The point in the life of an event (or of the scheduler) that a trace entry records.
+  */
+enum CodalTracePhase
+{
+    CODAL_TRACE_QUEUED = 1,                         // The event was added to the MessageBus queue.
+    CODAL_TRACE_MERGED,                             // The event was coalesced into an identical queued event.
+    CODAL_TRACE_DROPPED,                            // The event was dropped, as the MessageBus queue was full.
+    CODAL_TRACE_DISPATCHED,                         // The MessageBus took the event from its queue, and began delivering it.
+    CODAL_TRACE_HANDLER,                            // A handler was called with the event.
+    CODAL_TRACE_HANDLED,                            // A handler returned.
+    CODAL_TRACE_SWITCH                              // The scheduler switched fibers.
+};
+
+/**
+  * A single trace entry.
+  */
+struct CodalTraceEntry
+{
+    uint32_t timestamp;                             // The time of the entry, in microseconds.
+    uint16_t source;                                // The source of the event (zero for CODAL_TRACE_SWITCH).
+    uint16_t value;                                 // The value of the event (zero for CODAL_TRACE_SWITCH).
+    uint8_t phase;                                  // One of CodalTracePhase.
+    uint8_t fiber;                                  // The fiber the entry was recorded on.
+    uint16_t arg;                                   // For CODAL_TRACE_SWITCH, the fiber scheduled out.
+                                                    // For CODAL_TRACE_DROPPED, 1 if the event was dropped from the queue.
+};
+
+/**
+  * The trace ring. Laid out so that a binary dump of it is self-describing.
+  */
+struct CodalTraceStore
+{
+    uint32_t magic;                                 // CODAL_TRACE_MAGIC.
+    uint16_t size;                                  // The number of entries in the ring.
+    uint16_t entrySize;                             // sizeof(CodalTraceEntry).
+    uint32_t ptr;                                   // The number of entries recorded. The next is written at ptr % size.
+#if CODAL_TRACE_BUFFER_SIZE > 0
+    CodalTraceEntry entries[CODAL_TRACE_BUFFER_SIZE];
+#endif
+};
+
+#if CODAL_TRACE_BUFFER_SIZE > 0
+
+extern struct CodalTraceStore codalTraceStore;
+
+/**
+  * Records an entry in the trace ring, overwriting the oldest entry if it is full.
+  * Safe to call from interrupt context. Typically used via the CODAL_TRACE() macro.
+  *
+  * @param phase One of CodalTracePhase.
+  *
+  * @param source The source of the event.
+  *
+  * @param value The value of the event.
+  *
+  * @param arg Phase specific information.
+  */
+void codal_trace(uint8_t phase, uint16_t source, uint16_t value, uint16_t arg);
+
+/**
+  * Discards all entries in the trace ring.
+  */
+void codal_trace_reset();
+
+#define CODAL_TRACE     codal_trace
+
+#else
+
+#define CODAL_TRACE(...) ((void)0)
+
+#endif
+
+#endif
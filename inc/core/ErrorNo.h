@@ -72,6 +72,9 @@ enum ErrorCode{
 
     // An invalid state was detected (i.e. not initialised)
     DEVICE_INVALID_STATE = -1015,
+
+    // The requested operation did not complete before its timeout expired.
+    DEVICE_TIMEOUT = -1016,
 };
 
 /**
@@ -91,6 +94,9 @@ enum PanicCode{
     // Corruption detected in the codal device heap space
     DEVICE_HEAP_ERROR = 30,
 
+    // A fiber has overflowed its dedicated stack
+    DEVICE_STACK_OVERFLOW = 31,
+
     // Dereference of a NULL pointer through the ManagedType class,
     DEVICE_NULL_DEREFERENCE = 40,
 
@@ -113,6 +113,41 @@ namespace codal
             return NULL;
         }
 
+        /**
+          * Enables or disables coalescing of the queued events raised by the given source.
+          *
+          * @param id The id of the event source.
+          *
+          * @param enable true to merge identical queued events from this source, false to queue each event.
+          *
+          * @return This default implementation simply returns DEVICE_NOT_SUPPORTED.
+          */
+        virtual int setCoalescing(uint16_t, bool)
+        {
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        /**
+          * Registers a table of listeners fixed at compile time, each treated as MESSAGE_BUS_LISTENER_IMMEDIATE.
+          *
+          * This default implementation registers each entry as a dynamic listener.
+          *
+          * @param table The table of listeners, which must remain valid for the lifetime of the EventModel.
+          *
+          * @param count The number of entries in the table.
+          *
+          * @param context The context given to each handler in the table.
+          *
+          * @return DEVICE_OK on success.
+          */
+        virtual int addStaticListeners(const StaticListener *table, int count, void *context = NULL)
+        {
+            for (int i = 0; i < count; i++)
+                listen(table[i].id, table[i].value, table[i].cb, context, MESSAGE_BUS_LISTENER_IMMEDIATE);
+
+            return DEVICE_OK;
+        }
+
         /**
           * Define the default EventModel to use for events raised and consumed by the codal runtime.
           * The default EventModel may be changed at any time.
@@ -448,6 +483,76 @@ namespace codal
             return DEVICE_OK;
         }
 
+        /**
+          * Register a listener function that receives events in batches.
+          *
+          * Rather than being called once for each event, the handler is given every matching event delivered
+          * since it was last called, once the MessageBus has drained its queue, or MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH
+          * events have been collected. This suits high rate sources, such as telemetry and streams.
+          *
+          * @param id The source of messages to listen for. Events sent from any other IDs will be filtered.
+          * Use DEVICE_ID_ANY to receive events from all components.
+          *
+          * @param value The value of messages to listen for. Events with any other values will be filtered.
+          * Use DEVICE_EVT_ANY to receive events of any value.
+          *
+          * @param handler The function to call with each batch of events, and the number of events in it.
+          * The events are only valid until the handler returns. Events collected while the handler is running
+          * may be delivered in two batches, as they are held in a ring.
+          *
+          * @param arg Provide the callback with in an additional argument.
+          *
+          * @param flags User specified, implementation specific flags. Batches are never delivered urgently,
+          * so MESSAGE_BUS_LISTENER_URGENT may not be used.
+          *
+          * @return DEVICE_OK on success or DEVICE_INVALID_PARAMETER if the handler is NULL, or the flags are invalid.
+          *
+          * @code
+          * void onSamples(Event *events, int count, void *)
+          * {
+          *     for (int i = 0; i < count; i++)
+          *         log(events[i].timestamp, events[i].value);
+          * }
+          *
+          * uBit.messageBus.listen(DEVICE_ID_ACCELEROMETER, DEVICE_EVT_ANY, onSamples, NULL);
+          * @endcode
+          */
+        int listen(int id, int value, void (*handler)(Event *, int, void*), void* arg, uint16_t flags = EVENT_LISTENER_DEFAULT_FLAGS)
+        {
+            if (handler == NULL || (flags & MESSAGE_BUS_LISTENER_URGENT) || id == DEVICE_ID_SCHEDULER)
+                return DEVICE_INVALID_PARAMETER;
+
+            Listener *newListener = new Listener(id, value, handler, arg, flags);
+
+            if(add(newListener) == DEVICE_OK)
+                return DEVICE_OK;
+
+            delete newListener;
+
+            return DEVICE_NOT_SUPPORTED;
+        }
+
+        /**
+          * Unregister a listener function that receives events in batches.
+          *
+          * @param id The Event ID used to register the listener.
+          * @param value The Event value used to register the listener.
+          * @param handler The function used to register the listener.
+          *
+          * @return DEVICE_OK on success or DEVICE_INVALID_PARAMETER if the handler
+          *         given is NULL.
+          */
+        int ignore(int id, int value, void (*handler)(Event *, int, void*))
+        {
+            if (handler == NULL)
+                return DEVICE_INVALID_PARAMETER;
+
+            Listener listener(id, value, handler, NULL);
+            remove(&listener);
+
+            return DEVICE_OK;
+        }
+
         /**
           * Unregister a listener function.
           * Listners are identified by the Event ID, Event value and handler registered using listen().
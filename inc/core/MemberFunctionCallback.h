@@ -73,6 +73,16 @@ namespace codal
           * @param e The event to deliver to the method
           */
         void fire(Event e);
+
+        /**
+          * Allocates MemberFunctionCallbacks from a fixed size pool (CODAL_CALLBACK_SLAB_SIZE), falling back to the heap.
+          */
+        static void *operator new(size_t size);
+
+        /**
+          * Releases a MemberFunctionCallback allocated by operator new.
+          */
+        static void operator delete(void *p);
     };
 
     /**
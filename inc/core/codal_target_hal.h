@@ -53,6 +53,15 @@ extern "C"
 
     void target_panic(int statusCode);
 
+    /**
+      * Determines if the processor is currently handling an interrupt.
+      * The default implementation only detects interrupt context on Cortex-M, and returns 1 elsewhere.
+      * Other targets should provide their own, as nothing may block until they do.
+      *
+      * @return 1 if called from an interrupt handler, or if this cannot be determined. 0 otherwise.
+      */
+    int target_in_irq();
+
     PROCESSOR_WORD_TYPE fiber_initial_stack_base();
     /**
       * Configures the link register of the given tcb to have the value function.
@@ -29,11 +29,65 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalComponent.h"
 #include "Event.h"
 #include "CodalListener.h"
+#include "CodalFiber.h"
 #include "EventModel.h"
 
 
 namespace codal
 {
+    /**
+      * What the MessageBus does with an event that needs to be queued when its queue is full.
+      *
+      * MESSAGE_BUS_OVERFLOW_BLOCK relies on target_in_irq() to avoid blocking in interrupt context. Its default
+      * implementation only detects interrupts on Cortex-M, and assumes interrupt context elsewhere, so on other
+      * targets this policy drops the new event (as MESSAGE_BUS_OVERFLOW_DROP_NEWEST) until they provide their own.
+      */
+    enum MessageBusOverflowPolicy
+    {
+        MESSAGE_BUS_OVERFLOW_DROP_NEWEST,   // The new event is dropped.
+        MESSAGE_BUS_OVERFLOW_DROP_OLDEST,   // The oldest queued event is dropped to make space.
+        MESSAGE_BUS_OVERFLOW_BLOCK,         // The sender waits for space, if fiber_can_block(). Otherwise, the new event is dropped.
+        MESSAGE_BUS_OVERFLOW_GROW           // The queue grows, up to MESSAGE_BUS_QUEUE_GROW_LIMIT events.
+    };
+
+    /**
+      * Statistics gathered by the MessageBus about its event queue, to help size it correctly.
+      */
+    struct MessageBusStatistics
+    {
+        uint32_t            enqueued;       // The number of events queued for standard listeners.
+        uint32_t            merged;         // The number of events merged into a queued event, by coalescing sources.
+        uint32_t            dropped;        // The number of events lost because the queue was full.
+        uint16_t            maxDepth;       // The largest number of events held in the queue at once.
+        uint16_t            size;           // The number of events the queue can currently hold.
+
+        struct
+        {
+            uint16_t        id;             // An event source that has had events dropped, or DEVICE_ID_ANY if unused.
+            uint16_t        dropped;        // The number of events dropped from that source.
+        } sources[MESSAGE_BUS_STATS_DROP_SOURCES];  // The first sources to have events dropped.
+    };
+
+    /**
+      * A table of listeners fixed at compile time, registered with a MessageBus.
+      */
+    struct MessageBusStaticTable
+    {
+        const StaticListener    *table;         // The listeners, normally held in flash.
+        uint16_t                count;          // The number of entries in the table.
+        void                    *context;       // The context given to each handler.
+    };
+
+    /**
+      * A call to an event handler, waiting for a MessageBus worker fiber.
+      */
+    struct MessageBusHandlerJob
+    {
+        Listener            *listener;      // The listener to call.
+        Event               evt;            // The event to deliver to it.
+        uint8_t             merged;         // The number of events merged into evt.
+    };
+
     /**
       * Class definition for the MessageBus.
       *
@@ -142,13 +196,125 @@ namespace codal
           */
         virtual int remove(Listener *newListener);
 
+        /**
+          * Registers a table of listeners fixed at compile time, each treated as MESSAGE_BUS_LISTENER_IMMEDIATE.
+          *
+          * Static listeners are checked for every event before any dynamically registered listener, and need
+          * no heap allocation. Registering the same table with the same context more than once has no effect.
+          *
+          * @param table The table of listeners, which must remain valid for the lifetime of the MessageBus.
+          *
+          * @param count The number of entries in the table.
+          *
+          * @param context The context given to each handler in the table.
+          *
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if table is NULL, or DEVICE_NO_RESOURCES if
+          *         MESSAGE_BUS_STATIC_TABLES tables are already registered.
+          */
+        virtual int addStaticListeners(const StaticListener *table, int count, void *context = NULL);
+
+        /**
+          * Enables or disables coalescing of the queued events raised by the given source.
+          *
+          * While coalescing is enabled, an event that needs to be queued is merged into any identical event
+          * (same source and value) still waiting in the queue, rather than taking a place of its own. The queued
+          * event takes the timestamp of the latest event, and counts how many events were merged into it.
+          * Urgent listeners still receive every event. Merging happens even when the queue is full, so the
+          * latest state of a coalescing source is never lost.
+          *
+          * @param id The id of the event source.
+          *
+          * @param enable true to merge identical queued events from this source, false to queue each event.
+          *
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if id is DEVICE_ID_ANY, or DEVICE_NO_RESOURCES
+          *         if MESSAGE_BUS_COALESCE_SOURCES sources already have coalescing enabled.
+          */
+        virtual int setCoalescing(uint16_t id, bool enable);
+
+        /**
+          * Determines how many events were merged into the event currently being delivered to a standard listener.
+          * The count travels with the event to worker fibers and listener queues, so it is valid in any standard
+          * handler, but only until that handler blocks. It is not recorded for urgent handlers or batch handlers.
+          *
+          * @return the number of identical events merged into the current event, up to 255.
+          */
+        int getMergedCount();
+
+        /**
+          * Selects what happens to an event that needs to be queued when the queue is full.
+          *
+          * @param policy The new overflow policy.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the policy is not recognised.
+          */
+        int setOverflowPolicy(MessageBusOverflowPolicy policy);
+
+        /**
+          * Provides the statistics gathered about the event queue, since the MessageBus was created or the
+          * statistics were last reset.
+          *
+          * @param stats Updated with the current statistics.
+          *
+          * @param reset true to reset the statistics once read. Defaults to false.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if stats is NULL.
+          */
+        int getStatistics(MessageBusStatistics *stats, bool reset = false);
+
         private:
 
-        Listener            *listeners;           // Chain of active listeners.
-        EventQueueItem      *evt_queue_head;    // Head of queued events to be processed.
-        EventQueueItem      *evt_queue_tail;    // Tail of queued events to be processed.
+        Listener            *listeners[MESSAGE_BUS_LISTENER_BUCKETS + 1];         // Chains of standard listeners, indexed by source id.
+        Listener            *urgentListeners[MESSAGE_BUS_LISTENER_BUCKETS + 1];   // Chains of urgent (MESSAGE_BUS_LISTENER_IMMEDIATE) listeners, indexed by source id.
+        MessageBusStaticTable   staticTables[MESSAGE_BUS_STATIC_TABLES];         // Tables of listeners fixed at compile time.
+        uint8_t             staticTableCount;   // The number of static listener tables registered.
+        Event               *evt_queue;         // Ring of queued events to be processed.
+        uint8_t             *evt_queue_merged;  // The number of events merged into each queued event.
+        Event               evt_queue_storage[MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH];      // The initial queue, before any growth.
+        uint8_t             evt_queue_merged_storage[MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH];
+        MessageBusStatistics    stats;          // Statistics about the event queue.
+#if MESSAGE_BUS_COALESCE_SOURCES > 0
+        uint16_t            coalesceIds[MESSAGE_BUS_COALESCE_SOURCES];          // Sources with coalescing enabled, or DEVICE_ID_ANY if unused.
+#endif
+        uint8_t                     merged;             // The number of events merged into the event being dispatched.
+        uint16_t                    batchPending;       // The number of batch listeners holding events that are yet to be delivered.
+        FiberLock                   queueSpace;         // Blocks senders waiting for space in the queue, with MESSAGE_BUS_OVERFLOW_BLOCK.
+
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+        MessageBusHandlerJob        handlerJobs[MESSAGE_BUS_HANDLER_QUEUE_SIZE];   // Ring of handler calls waiting for a worker fiber.
+        uint8_t                     handlerJobHead;     // Position in the ring of the oldest handler call.
+        uint8_t                     handlerJobCount;    // The number of handler calls waiting for a worker fiber.
+        uint8_t                     handlerWorkers;     // The number of worker fibers created so far.
+        FiberLock                   handlerJobsWaiting; // Counts waiting handler calls, and blocks idle worker fibers.
+
+        /**
+          * Queues a call to the given listener, to be run by a worker fiber.
+          *
+          * @param listener The listener to call.
+          *
+          * @param evt The event to deliver.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the handler queue is full.
+          */
+        int queueHandler(Listener *listener, Event &evt);
+
+        /**
+          * Determines if a call to the given listener is waiting for a worker fiber.
+          */
+        bool handlerQueued(Listener *listener);
+
+        /**
+          * The body of each worker fiber: runs queued handler calls, in the order in which they were queued.
+          *
+          * @param bus The MessageBus that owns this worker.
+          */
+        static void handlerWorker(void *bus);
+#endif
         uint16_t                    nonce_val;          // The last nonce issued.
+        uint16_t                    queueHead;          // Position in the ring of the oldest event waiting to be processed.
         uint16_t                    queueLength;        // The number of events currently waiting to be processed.
+        uint16_t                    queueDequeued;      // The number of events removed from the ring so far (wrapping).
+        uint16_t                    queueSize;          // The number of events the ring can hold.
+        uint8_t                     overflowPolicy;     // The MessageBusOverflowPolicy in use.
 
         /**
           * Cleanup any Listeners marked for deletion from the list.
@@ -157,6 +323,40 @@ namespace codal
           */
         int deleteMarkedListeners();
 
+        /**
+          * Delivers the given event to each matching listener held in the given listener table.
+          *
+          * @param table The listener table to walk.
+          *
+          * @param evt The event to deliver.
+          *
+          * @param mergeCount The number of events merged into evt.
+          */
+        void dispatch(Listener **table, Event &evt, uint8_t mergeCount = 0);
+
+        /**
+          * Calls the given listener, directly or on another fiber as its flags require.
+          *
+          * @param l The listener to call.
+          *
+          * @param evt The event to deliver.
+          */
+        void deliver(Listener *l, Event &evt);
+
+        /**
+          * Adds the given event to the batch collected by the given MESSAGE_BUS_LISTENER_BATCH listener.
+          *
+          * @param l The listener.
+          *
+          * @param evt The event to add.
+          */
+        void batchEvent(Listener *l, Event &evt);
+
+        /**
+          * Delivers the events collected by each batch listener.
+          */
+        void flushBatches();
+
         /**
           * Queue the given event for processing at a later time.
           * Add the given event at the tail of our queue.
@@ -168,9 +368,26 @@ namespace codal
         /**
           * Extract the next event from the front of the event queue (if present).
           *
-          * @return a pointer to the EventQueueItem that is at the head of the list.
+          * @param evt Updated with the event at the front of the queue.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NO_DATA if the queue is empty.
+          */
+        int dequeueEvent(Event &evt);
+
+        /**
+          * Doubles the capacity of the event queue, up to MESSAGE_BUS_QUEUE_GROW_LIMIT events.
+          * Must be called with interrupts disabled, and returns with interrupts disabled.
+          *
+          * @return DEVICE_OK if the queue has grown, or DEVICE_NO_RESOURCES if it cannot.
+          */
+        int growQueue();
+
+        /**
+          * Records that an event from the given source has been dropped.
+          *
+          * @param id The source of the dropped event.
           */
-        EventQueueItem* dequeueEvent();
+        void recordDrop(uint16_t id);
 
         /**
           * Periodic callback from Device.
@@ -179,6 +396,11 @@ namespace codal
           * We then continue processing events until something appears on the runqueue.
           */
         void idle(Event);
+
+        /**
+          * Static listener for scheduler idle events, calling idle() on the given MessageBus.
+          */
+        static void idleCallback(Event evt, void *bus);
     };
 
     /**
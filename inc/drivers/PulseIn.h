@@ -39,8 +39,6 @@ class PulseIn : public PinPeripheral
     Pin             &pin;
     uint32_t        lastPeriod;
     FiberLock       lock;
-    CODAL_TIMESTAMP timeout;   
-    static bool     timeoutGeneratorStarted;
     bool            enabled;
 
     public:
@@ -68,12 +66,6 @@ class PulseIn : public PinPeripheral
     void
     onPulse(Event e);
 
-    /**
-     * Event handler called when a timeout event is generated.
-     */
-    void
-    onTimeout(Event e);
-
     /**
     * Method to release the given pin from a peripheral, if already bound.
     * Device drivers should override this method to disconnect themselves from the give pin
@@ -0,0 +1,107 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_EVENT_RING_H
+#define CODAL_EVENT_RING_H
+
+#include "CodalConfig.h"
+#include "Event.h"
+
+namespace codal
+{
+    /**
+      * A fixed size ring of events, pushed by an interrupt handler and delivered later in thread context.
+      *
+      * Raising an Event from an interrupt handler runs every urgent listener and queues the event on the
+      * MessageBus with interrupts disabled. Instead, an interrupt handler can push() events onto an EventRing
+      * of its own. This takes a short, bounded time and never disables interrupts. The MessageBus drains every
+      * EventRing when the scheduler is next idle, and delivers each event as if it had been raised then.
+      *
+      * An EventRing is lock free, so it must have a single producer: one interrupt handler, or code that
+      * cannot be preempted by any other code pushing onto the same ring. As the ring is drained from the
+      * idle fiber, it must not be allocated on a fiber's stack.
+      *
+      * Events are only delivered once no fiber is runnable, so while other fibers keep the scheduler busy,
+      * any fiber waiting for one of these events stays blocked. Events that wake fibers which must respond
+      * promptly (such as a driver's data received events) should be raised directly instead.
+      */
+    class EventRing
+    {
+        Event               *slots;         // Storage for size + 1 events, so that a full ring can be told from an empty one.
+        uint8_t             size;           // The number of events this ring may hold.
+        volatile uint8_t    head;           // Position of the next event to be pushed. Only written by the producer.
+        volatile uint8_t    tail;           // Position of the next event to be delivered. Only written by the consumer.
+        EventRing           *next;          // The next EventRing in the list of rings to be drained.
+
+        static EventRing    *rings;         // The list of all EventRings.
+
+        public:
+
+        volatile uint16_t   dropped;        // The number of events lost because the ring was full.
+
+        /**
+          * Constructor.
+          *
+          * Creates a new EventRing, and adds it to the list of rings drained by the MessageBus.
+          *
+          * @param size The number of events this ring may hold. If zero, events are raised as soon as they are pushed.
+          *             Defaults to CODAL_EVENT_RING_SIZE.
+          */
+        EventRing(uint8_t size = CODAL_EVENT_RING_SIZE);
+
+        /**
+          * Adds the given event to this ring, to be delivered in thread context. Safe to call from an interrupt handler.
+          *
+          * @param evt The event to deliver, normally created using the CREATE_ONLY launch mode.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the ring is full and the event was dropped.
+          */
+        int push(Event evt);
+
+        /**
+          * Removes the oldest event from this ring. Must only be called in thread context.
+          *
+          * @param evt Updated with the oldest event in the ring.
+          *
+          * @return DEVICE_OK on success, or DEVICE_NO_DATA if the ring is empty.
+          */
+        int pop(Event &evt);
+
+        /**
+          * Raises every event held in every EventRing, in the order in which they were pushed onto each ring.
+          * Called by the MessageBus when the scheduler is idle.
+          *
+          * @return the number of events raised.
+          */
+        static int drain();
+
+        /**
+          * Destructor. Removes this ring from the list of rings drained by the MessageBus.
+          * Any events still held in the ring are discarded.
+          */
+        ~EventRing();
+    };
+}
+
+#endif
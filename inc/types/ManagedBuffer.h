@@ -30,6 +30,8 @@ DEALINGS IN THE SOFTWARE.
 
 namespace codal
 {
+    class CodalArena;
+
     struct BufferData : RefCounted
     {
         uint16_t        length;             // The length of the payload in bytes
@@ -77,6 +79,37 @@ namespace codal
           */
         ManagedBuffer(int length, BufferInitialize initialize = BufferInitialize::Zero);
 
+        /**
+          * Constructor.
+          * Creates a new ManagedBuffer of the given size, in the given arena if it has space, or otherwise on the heap.
+          * A buffer held in an arena must not be referenced after the ArenaScope it was created within ends.
+          *
+          * @param length The length of the buffer to create.
+          * @param arena The arena to create the buffer in, or NULL to create it on the heap.
+          *
+          * Example:
+          * @code
+          * ManagedBuffer p(256, ArenaScope::current());    // Creates a 256 byte buffer, in the current arena if any.
+          * @endcode
+          */
+        ManagedBuffer(int length, CodalArena *arena, BufferInitialize initialize = BufferInitialize::Zero);
+
+        /**
+          * Constructor.
+          * Creates a new ManagedBuffer of the given size, placed on the heap according to the given hint.
+          *
+          * @param length The length of the buffer to create.
+          * @param initialize The initialization mode to use for the buffer.
+          * @param heapHint The intended use of the buffer (any of DEVICE_HEAP_FAST, DEVICE_HEAP_LARGE, DEVICE_HEAP_DMA).
+          * DEVICE_HEAP_DMA is a requirement, so should only be given for buffers passed to a DMA controller.
+          *
+          * Example:
+          * @code
+          * ManagedBuffer p(512, BufferInitialize::None, DEVICE_HEAP_DMA);  // Creates a 512 byte buffer a DMA controller can read.
+          * @endcode
+          */
+        ManagedBuffer(int length, BufferInitialize initialize, uint8_t heapHint);
+
         /**
           * Constructor.
           * Creates an empty ManagedBuffer of the given size,
@@ -127,9 +160,11 @@ namespace codal
          * @param data The data with which to fill the buffer.
          * @param length The length of the buffer to create.
          * @param initialize The initialization mode to use for the allocted memory in the buffer
+         * @param arena The arena to create the buffer in, or NULL to create it on the heap.
+         * @param heapHint The heap allocation hint used if the buffer is created on the heap (see device_malloc_hint()).
          *
          */
-        void init(uint8_t *data, int length, BufferInitialize initialize);
+        void init(uint8_t *data, int length, BufferInitialize initialize, CodalArena *arena = NULL, uint8_t heapHint = CODAL_MANAGED_BUFFER_HEAP_HINT);
 
         /**
           * Destructor.
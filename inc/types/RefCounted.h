@@ -27,6 +27,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "CodalConfig.h"
 #include "CodalDevice.h"
+#include "CodalHeapAllocator.h"
 
 namespace codal
 {
@@ -91,7 +92,8 @@ namespace codal
             __attribute__((aligned(4))) = {0xffff, REF_TAG, __VA_ARGS__};
     #define REF_COUNTED_INIT(ptr)                                                                      \
         ptr->init();                                                                                   \
-        ptr->tag = REF_TAG
+        ptr->tag = REF_TAG;                                                                            \
+        DEVICE_HEAP_TAG(ptr, REF_TAG)
     #else
     #define REF_COUNTED_DEF_EMPTY(className, ...)                                                      \
         static const uint16_t emptyData[] __attribute__((aligned(4))) = {0xffff, __VA_ARGS__};
@@ -0,0 +1,244 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * A region of memory for short lived scratch allocations, released all at once when a scope ends.
+  */
+#include "CodalConfig.h"
+#include "CodalArena.h"
+#include "CodalHeapAllocator.h"
+#include "ErrorNo.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+#define ARENA_ALIGN(x)  (((x) + sizeof(PROCESSOR_WORD_TYPE) - 1) & ~(sizeof(PROCESSOR_WORD_TYPE) - 1))
+
+CodalArena *CodalArena::arenas = NULL;
+ArenaScope *ArenaScope::active = NULL;
+
+/**
+  * Constructor.
+  * Creates an arena of the given size, in fast memory if available.
+  *
+  * @param size The size of the arena, in bytes.
+  */
+CodalArena::CodalArena(uint32_t size) : CodalArena(device_malloc_hint(size, DEVICE_HEAP_FAST), size)
+{
+    owned = true;
+
+    if (storage == NULL)
+        this->size = 0;
+}
+
+/**
+  * Constructor.
+  * Creates an arena in the given memory, which must remain valid for the lifetime of the arena.
+  *
+  * @param storage The memory to use, aligned to a processor word.
+  * @param size The size of the memory, in bytes.
+  */
+CodalArena::CodalArena(void *storage, uint32_t size)
+{
+    this->storage = (uint8_t *)storage;
+    this->size = size;
+    this->used = 0;
+    this->peak = 0;
+    this->fallbacks = 0;
+    this->owned = false;
+    this->scope = NULL;
+
+    target_disable_irq();
+    this->next = arenas;
+    arenas = this;
+    target_enable_irq();
+}
+
+/**
+  * Destructor.
+  */
+CodalArena::~CodalArena()
+{
+    target_disable_irq();
+
+    for (CodalArena **a = &arenas; *a != NULL; a = &(*a)->next)
+    {
+        if (*a == this)
+        {
+            *a = next;
+            break;
+        }
+    }
+
+    target_enable_irq();
+
+    if (owned)
+        free(storage);
+}
+
+/**
+  * Allocates memory from this arena. The memory remains valid until the innermost ArenaScope on this arena ends.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  * @param refCounted true if the memory will hold a RefCounted object. The arena then checks that the object
+  * is no longer referenced when the scope ends.
+  *
+  * @return A pointer to the memory, or NULL if the arena is full (or has no active scope).
+  */
+REAL_TIME_FUNC
+void *CodalArena::allocate(uint32_t size, bool refCounted)
+{
+    void *p = NULL;
+
+    size = ARENA_ALIGN(size);
+
+    target_disable_irq();
+
+    if (scope != NULL && size <= this->size - used)
+    {
+        p = storage + used;
+        used += size;
+
+        if (used > peak)
+            peak = used;
+
+        if (refCounted)
+            scope->live++;
+    }
+    else
+    {
+        fallbacks++;
+    }
+
+    target_enable_irq();
+
+    return p;
+}
+
+/**
+  * Records that a RefCounted object is no longer referenced. Called by RefCounted::decr() for every object,
+  * so that objects in an arena are not passed to the heap. The object is charged to the scope it was
+  * allocated within, which is the scope whose part of the arena holds it.
+  *
+  * @param p The object.
+  *
+  * @return true if the object is held in an arena, false otherwise.
+  */
+REAL_TIME_FUNC
+bool CodalArena::release(void *p)
+{
+    for (CodalArena *a = arenas; a != NULL; a = a->next)
+    {
+        if (a->contains(p))
+        {
+            target_disable_irq();
+
+            // Each scope owns the memory allocated from its mark to the mark of the scope nested within it.
+            uint32_t offset = (uint8_t *)p - a->storage;
+            uint32_t limit = a->used;
+
+            for (ArenaScope *s = a->scope; s != NULL; s = s->outer)
+            {
+                if (offset >= s->mark && offset < limit)
+                {
+                    s->live--;
+                    break;
+                }
+
+                limit = s->mark;
+            }
+
+            target_enable_irq();
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+  * Constructor.
+  * Begins a scope on the given arena, making it the current arena for this fiber.
+  *
+  * @param arena The arena to allocate from.
+  */
+ArenaScope::ArenaScope(CodalArena &arena) : arena(arena)
+{
+    target_disable_irq();
+
+    mark = arena.used;
+    live = 0;
+    fiber = currentFiber;
+    outer = arena.scope;
+    next = active;
+
+    arena.scope = this;
+    active = this;
+
+    target_enable_irq();
+}
+
+/**
+  * Destructor.
+  * Releases all memory allocated from the arena since this scope began.
+  */
+ArenaScope::~ArenaScope()
+{
+    target_disable_irq();
+
+    // Any object allocated in this scope that is still referenced would be left dangling,
+    // as would the memory of any scope nested within this one that has yet to end.
+    if (live != 0 || arena.scope != this)
+        target_panic(DEVICE_HEAP_ERROR);
+
+    arena.used = mark;
+    arena.scope = outer;
+
+    for (ArenaScope **s = &active; *s != NULL; s = &(*s)->next)
+    {
+        if (*s == this)
+        {
+            *s = next;
+            break;
+        }
+    }
+
+    target_enable_irq();
+}
+
+/**
+  * Determines the arena of the innermost scope active on the current fiber.
+  *
+  * @return The arena, or NULL if there is no scope active on this fiber.
+  */
+REAL_TIME_FUNC
+CodalArena *ArenaScope::current()
+{
+    for (ArenaScope *s = active; s != NULL; s = s->next)
+        if (s->fiber == currentFiber)
+            return &s->arena;
+
+    return NULL;
+}
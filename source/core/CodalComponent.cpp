@@ -50,7 +50,7 @@ uint16_t CodalComponent::generateDynamicID() {
 /**
   * The periodic callback for all components.
   */
-void component_callback(Event evt)
+static void component_callback(Event evt, void *)
 {
     uint8_t i = 0;
 
@@ -98,12 +98,21 @@ void CodalComponent::addComponent()
 
     if(!(configuration & DEVICE_COMPONENT_LISTENERS_CONFIGURED) && EventModel::defaultEventBus)
     {
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+        // The scheduler raises system ticks itself, and only while a component requires them.
+        int ret = DEVICE_OK;
+#else
         int ret = system_timer_event_every_us(SCHEDULER_TICK_PERIOD_US, DEVICE_ID_COMPONENT, DEVICE_COMPONENT_EVT_SYSTEM_TICK);
+#endif
 
         if(ret == DEVICE_OK)
         {
-            EventModel::defaultEventBus->listen(DEVICE_ID_COMPONENT, DEVICE_COMPONENT_EVT_SYSTEM_TICK, component_callback, MESSAGE_BUS_LISTENER_IMMEDIATE);
-            EventModel::defaultEventBus->listen(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE, component_callback, MESSAGE_BUS_LISTENER_IMMEDIATE);
+            static constexpr StaticListener componentListeners[] = {
+                { DEVICE_ID_COMPONENT, DEVICE_COMPONENT_EVT_SYSTEM_TICK, component_callback },
+                { DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE, component_callback },
+            };
+
+            EventModel::defaultEventBus->addStaticListeners(componentListeners, 2);
 
             CodalComponent::configuration |= DEVICE_COMPONENT_LISTENERS_CONFIGURED;
         }
@@ -129,6 +138,20 @@ void CodalComponent::removeComponent()
     }
 }
 
+/**
+  * Determines if any component has requested a periodic callback (DEVICE_COMPONENT_STATUS_SYSTEM_TICK).
+  */
+bool CodalComponent::systemTickRequired()
+{
+    for (int i = 0; i < DEVICE_COMPONENT_COUNT; i++)
+    {
+        if (components[i] && components[i]->status & DEVICE_COMPONENT_STATUS_SYSTEM_TICK)
+            return true;
+    }
+
+    return false;
+}
+
 /**
  * Puts all components in (or out of) sleep (low power) mode.
  */
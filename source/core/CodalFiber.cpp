@@ -27,8 +27,16 @@ DEALINGS IN THE SOFTWARE.
 #include "Timer.h"
 #include "codal_target_hal.h"
 #include "CodalDmesg.h"
+#include "CodalComponent.h"
+#include "CodalCompat.h"
+#include "CodalTrace.h"
+#include "CodalHeapAllocator.h"
 
-#define INITIAL_STACK_DEPTH (fiber_initial_stack_base() - 0x04)
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+#define INITIAL_STACK_DEPTH(f) ((f)->stack_top - 0x04)
+#else
+#define INITIAL_STACK_DEPTH(f) (fiber_initial_stack_base() - 0x04)
+#endif
 
 
 /*
@@ -44,9 +52,16 @@ static Fiber *idleFiber = NULL;                    // the idle task - performs a
 /*
  * Scheduler state.
  */
-static Fiber *runQueue = NULL;                     // The list of runnable fibers.
+static Fiber *runQueue[CODAL_FIBER_PRIORITY_LEVELS];  // The lists of runnable fibers, one per priority level.
+static uint32_t runQueueMap = 0;                   // Bitmap of the priority levels with runnable fibers.
+#if CODAL_FIBER_PRIORITY_AGING > 0
+static uint8_t runQueueAge[CODAL_FIBER_PRIORITY_LEVELS];  // The number of times each priority level has been passed over.
+#endif
+static Fiber *timedWaitList = NULL;                // The fibers in a timed wait, in no particular order.
+static uint32_t timedWaitDeadline = 0;             // The time (in milliseconds) the first timed wait may expire.
 static Fiber *sleepQueue = NULL;                   // The list of blocked fibers waiting on a fiber_sleep() operation.
-static Fiber *waitQueue = NULL;                    // The list of blocked fibers waiting on an event.
+static Fiber *waitQueue[CODAL_FIBER_WAIT_QUEUE_BUCKETS + 1];  // The lists of blocked fibers waiting on an event, hashed by id and value.
+static Fiber *selectQueue = NULL;                  // The list of blocked fibers waiting on any of a number of events.
 static Fiber *fiberPool = NULL;                    // Pool of unused fibers, just waiting for a job to do.
 static Fiber *fiberList = NULL;                    // List of all active Fibers (excludes those in the fiberPool)
 
@@ -55,6 +70,11 @@ static Fiber *fiberList = NULL;                    // List of all active Fibers
  */
 static uint8_t fiber_flags = 0;
 
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+static CODAL_TIMESTAMP tickDeadline = 0;           // The time (in microseconds) of the pending scheduler tick, if any.
+static CODAL_TIMESTAMP componentTickDue = 0;       // The time (in microseconds) the next component system tick is due.
+#endif
+
 /*
  * Fibers may perform wait/notify semantics on events. If set, these operations will be permitted on this EventModel.
  */
@@ -63,6 +83,237 @@ static EventModel *messageBus = NULL;
 
 using namespace codal;
 
+#if CODAL_FIBER_PRIORITY_LEVELS < 1 || CODAL_FIBER_PRIORITY_LEVELS > 32
+#error "CODAL_FIBER_PRIORITY_LEVELS must be between 1 and 32"
+#endif
+
+/**
+  * Determines the priority level represented by the given queue.
+  *
+  * @return The priority level, or -1 if the queue is not a run queue.
+  */
+static inline int runqueue_level(Fiber **queue)
+{
+    if (queue >= runQueue && queue < runQueue + CODAL_FIBER_PRIORITY_LEVELS)
+        return queue - runQueue;
+
+    return -1;
+}
+
+/**
+  * Determines the highest priority level with runnable fibers, in constant time.
+  *
+  * @return The priority level, or -1 if no fibers are runnable.
+  */
+static inline int runqueue_highest_level()
+{
+    return runQueueMap ? 31 - __builtin_clz(runQueueMap) : -1;
+}
+
+/**
+  * Limits the given priority to those supported by this configuration.
+  */
+static inline uint8_t fiber_priority_level(int priority)
+{
+    if (priority < 0)
+        return 0;
+
+    return priority < CODAL_FIBER_PRIORITY_LEVELS ? priority : CODAL_FIBER_PRIORITY_LEVELS - 1;
+}
+
+/**
+  * Adds the given fiber to the run queue for its priority.
+  */
+static inline void queue_runnable_fiber(Fiber *f)
+{
+    queue_fiber(f, &runQueue[f->priority]);
+}
+
+/**
+  * Records that the given fiber has become runnable, and is waiting to be scheduled in.
+  */
+static inline void fiber_stats_runnable(Fiber *f)
+{
+#if CONFIG_ENABLED(CODAL_FIBER_STATS)
+    f->stats.timestamp = system_timer_current_time_us();
+#endif
+}
+
+#if CONFIG_ENABLED(CODAL_FIBER_STATS)
+/**
+  * Records a context switch between the given fibers.
+  */
+static void fiber_stats_switch(Fiber *from, Fiber *to)
+{
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+
+    from->stats.runTime += now - from->stats.timestamp;
+    from->stats.timestamp = now;
+
+    // The idle fiber is never on the run queue, so never waits.
+    if (to != idleFiber)
+        to->stats.waitTime += now - to->stats.timestamp;
+
+    to->stats.switches++;
+    to->stats.timestamp = now;
+}
+#endif
+
+/**
+  * Makes the given blocked fiber runnable, cancelling any timed wait it is in.
+  */
+REAL_TIME_FUNC
+static void wake_fiber(Fiber *f)
+{
+    target_disable_irq();
+
+    dequeue_fiber(f);
+
+    if (f->flags & DEVICE_FIBER_FLAG_TIMED_WAIT)
+    {
+        f->flags &= ~DEVICE_FIBER_FLAG_TIMED_WAIT;
+
+        for (Fiber **p = &timedWaitList; *p != NULL; p = &(*p)->tnext)
+        {
+            if (*p == f)
+            {
+                *p = f->tnext;
+                break;
+            }
+        }
+    }
+
+    queue_runnable_fiber(f);
+    fiber_stats_runnable(f);
+
+    target_enable_irq();
+}
+
+/**
+  * Starts a timed wait for the given fiber, which should be about to block.
+  * If the fiber is still blocked when the timeout expires, the scheduler makes it runnable again,
+  * flagged with DEVICE_FIBER_FLAG_TIMED_OUT.
+  *
+  * @param f The fiber that is about to block.
+  *
+  * @param timeout The period of time to wait, in milliseconds.
+  *
+  * @param lock The FiberLock the fiber is about to block on, or NULL if it is about to wait for an event.
+  */
+static void fiber_start_timed_wait(Fiber *f, uint32_t timeout, FiberLock *lock = NULL)
+{
+    target_disable_irq();
+
+    f->timeout = system_timer_current_time() + timeout;
+    f->lock = lock;
+    f->flags = (f->flags & ~DEVICE_FIBER_FLAG_TIMED_OUT) | DEVICE_FIBER_FLAG_TIMED_WAIT;
+
+    if (timedWaitList == NULL || f->timeout < timedWaitDeadline)
+        timedWaitDeadline = f->timeout;
+
+    f->tnext = timedWaitList;
+    timedWaitList = f;
+
+    target_enable_irq();
+}
+
+/**
+  * Determines if the calling fiber's last timed wait expired, and clears the indication.
+  */
+static int fiber_timed_out()
+{
+    int timedOut = currentFiber->flags & DEVICE_FIBER_FLAG_TIMED_OUT;
+
+    currentFiber->flags &= ~DEVICE_FIBER_FLAG_TIMED_OUT;
+
+    return timedOut;
+}
+
+/**
+  * A fiber blocked in fiber_wait_for_any(), and the events it is waiting for.
+  * Held on the heap, as the caller's stack may be paged out while it waits.
+  */
+struct FiberSelect
+{
+    Fiber *fiber;                                   // The waiting fiber.
+    FiberSelect *next;                              // The next waiting fiber on the select list.
+    Event evt;                                      // The event that woke the fiber.
+    int n;                                          // The number of filters.
+    EventFilter *filters;                           // The events to wait for, stored immediately after this structure.
+};
+
+static FiberSelect *selectList = NULL;             // The fibers in fiber_wait_for_any(), in the order they started waiting.
+
+// The wait queue bucket holding fibers that wait on DEVICE_ID_ANY or DEVICE_EVT_ANY.
+#define WAIT_QUEUE_WILDCARD     CODAL_FIBER_WAIT_QUEUE_BUCKETS
+
+/**
+  * Determines the wait queue bucket used for fibers waiting on the given event id and value.
+  */
+static inline int wait_queue_bucket(uint16_t id, uint16_t value)
+{
+#if CODAL_FIBER_WAIT_QUEUE_BUCKETS > 0
+    if (id != DEVICE_ID_ANY && value != DEVICE_EVT_ANY)
+        return (id ^ (value * 31)) % CODAL_FIBER_WAIT_QUEUE_BUCKETS;
+#endif
+
+    return WAIT_QUEUE_WILDCARD;
+}
+
+namespace codal
+{
+    /**
+      * Abandons the FiberLock::wait() of the given fiber, as its timeout has expired.
+      */
+    void fiber_lock_timeout(Fiber *f)
+    {
+        // Give back the count taken by wait().
+        f->lock->locked++;
+    }
+}
+
+/**
+  * Wakes up any fibers whose timed wait has expired.
+  * Timed waits are rare and short lived, so rather than keep them in order we simply search the
+  * list of timed waits once the earliest timeout is due.
+  *
+  * @param now The current time, in milliseconds.
+  */
+static void scheduler_expire_timed_waits(CODAL_TIMESTAMP now)
+{
+    if (timedWaitList == NULL || now < timedWaitDeadline)
+        return;
+
+    target_disable_irq();
+
+    uint32_t deadline = 0;
+    int waiting = 0;
+    Fiber *next;
+
+    for (Fiber *f = timedWaitList; f != NULL; f = next)
+    {
+        // Waking the fiber removes it from the list.
+        next = f->tnext;
+
+        if (now >= f->timeout)
+        {
+            if (f->lock)
+                fiber_lock_timeout(f);
+
+            f->flags |= DEVICE_FIBER_FLAG_TIMED_OUT;
+            wake_fiber(f);
+        }
+        else if (waiting++ == 0 || f->timeout < deadline)
+        {
+            deadline = f->timeout;
+        }
+    }
+
+    timedWaitDeadline = deadline;
+
+    target_enable_irq();
+}
+
 REAL_TIME_FUNC
 void codal::queue_fiber(Fiber *f, Fiber **queue)
 {
@@ -70,27 +321,72 @@ void codal::queue_fiber(Fiber *f, Fiber **queue)
 
     // Record which queue this fiber is on.
     f->queue = queue;
+    f->qnext = NULL;
 
-    // Add the fiber to the tail of the queue. Although this involves scanning the
-    // list, it results in fairer scheduling.
+    // Add the fiber to the tail of the queue, which results in fairer scheduling.
+    // The qprev field of the head of a queue refers to its tail, so this is a constant time operation
+    // without needing any additional RAM to hold a tail pointer.
     if (*queue == NULL)
     {
-        f->qnext = NULL;
-        f->qprev = NULL;
+        f->qprev = f;
         *queue = f;
     }
     else
     {
-        // Scan to the end of the queue.
-        // We don't maintain a tail pointer to save RAM (queues are nrmally very short).
-        Fiber *last = *queue;
-
-        while (last->qnext != NULL)
-            last = last->qnext;
+        Fiber *last = (*queue)->qprev;
 
         last->qnext = f;
         f->qprev = last;
-        f->qnext = NULL;
+        (*queue)->qprev = f;
+    }
+
+    // Record that this priority level has runnable fibers.
+    int level = runqueue_level(queue);
+    if (level >= 0)
+        runQueueMap |= 1UL << level;
+
+    target_enable_irq();
+}
+
+/**
+  * Adds the given fiber to the sleep queue, which is kept sorted by wake up time (held in the context field).
+  * Fibers with the same wake up time are woken in the order they went to sleep.
+  *
+  * @param f The fiber to add to the queue
+  */
+REAL_TIME_FUNC
+static void queue_sleeping_fiber(Fiber *f)
+{
+    target_disable_irq();
+
+    // Search backwards from the tail, as fibers typically sleep for similar periods of time.
+    Fiber *p = sleepQueue ? sleepQueue->qprev : NULL;
+
+    while (p != NULL && p->context > f->context)
+        p = (p == sleepQueue) ? NULL : p->qprev;
+
+    if (sleepQueue == NULL || (p != NULL && p->qnext == NULL))
+    {
+        // Empty queue, or we wake last. Just add to the tail.
+        queue_fiber(f, &sleepQueue);
+    }
+    else if (p == NULL)
+    {
+        // We wake first. Become the new head, inheriting the reference to the tail.
+        f->queue = &sleepQueue;
+        f->qnext = sleepQueue;
+        f->qprev = sleepQueue->qprev;
+        sleepQueue->qprev = f;
+        sleepQueue = f;
+    }
+    else
+    {
+        // Insert after p.
+        f->queue = &sleepQueue;
+        f->qnext = p->qnext;
+        f->qprev = p;
+        p->qnext->qprev = f;
+        p->qnext = f;
     }
 
     target_enable_irq();
@@ -106,13 +402,26 @@ void codal::dequeue_fiber(Fiber *f)
     // Remove this fiber fromm whichever queue it is on.
     target_disable_irq();
 
-    if (f->qprev != NULL)
-        f->qprev->qnext = f->qnext;
-    else
+    Fiber *head = *(f->queue);
+
+    // The head of the queue has no predecessor; its qprev field refers to the tail of the queue.
+    if (f == head)
         *(f->queue) = f->qnext;
+    else
+        f->qprev->qnext = f->qnext;
 
-    if(f->qnext)
+    if (f->qnext)
         f->qnext->qprev = f->qprev;
+    else if (f != head)
+        head->qprev = f->qprev;
+
+    // Record when a priority level has no more runnable fibers.
+    if (*(f->queue) == NULL)
+    {
+        int level = runqueue_level(f->queue);
+        if (level >= 0)
+            runQueueMap &= ~(1UL << level);
+    }
 
     f->qnext = NULL;
     f->qprev = NULL;
@@ -126,6 +435,48 @@ Fiber * codal::get_fiber_list()
     return fiberList;
 }
 
+Fiber * codal::fiber_list_next(Fiber *f)
+{
+    return f ? f->next : fiberList;
+}
+
+int codal::fiber_get_stats(Fiber *f, FiberStats *stats)
+{
+#if CONFIG_ENABLED(CODAL_FIBER_STATS)
+    if (f == NULL || stats == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+    *stats = f->stats;
+    target_enable_irq();
+
+    // Include the time the calling fiber has been running so far.
+    if (f == currentFiber)
+        stats->runTime += system_timer_current_time_us() - stats->timestamp;
+
+    return DEVICE_OK;
+#else
+    return DEVICE_NOT_SUPPORTED;
+#endif
+}
+
+void codal::fiber_dump_stats()
+{
+#if CONFIG_ENABLED(CODAL_FIBER_STATS)
+    FiberStats stats;
+
+    DMESG("FIBER STATS (us): current %p idle %p", (uint32_t)(PROCESSOR_WORD_TYPE)currentFiber, (uint32_t)(PROCESSOR_WORD_TYPE)idleFiber);
+
+    for (Fiber *f = fiber_list_next(NULL); f; f = fiber_list_next(f))
+    {
+        fiber_get_stats(f, &stats);
+
+        DMESG("%p: pri %d switches %d run %d wait %d stack %d", (uint32_t)(PROCESSOR_WORD_TYPE)f, f->priority,
+            stats.switches, (uint32_t)stats.runTime, (uint32_t)stats.waitTime, stats.maxStackDepth);
+    }
+#endif
+}
+
 REAL_TIME_FUNC
 Fiber *getFiberContext()
 {
@@ -151,17 +502,33 @@ Fiber *getFiberContext()
 
         f->stack_bottom = 0;
         f->stack_top = 0;
+
+#if CODAL_TRACE_BUFFER_SIZE > 0
+        // Number fibers as they are created, avoiding the ids reserved for entries recorded outside of any fiber.
+        static uint8_t traceIds = CODAL_TRACE_FIBER_NONE;
+
+        if (++traceIds == CODAL_TRACE_FIBER_IRQ)
+            traceIds = CODAL_TRACE_FIBER_NONE + 1;
+
+        f->trace_id = traceIds;
+#endif
     }
 
     target_enable_irq();
 
     // Ensure this fiber is in suitable state for reuse.
     f->flags = 0;
+    f->priority = fiber_priority_level(DEVICE_FIBER_PRIORITY_NORMAL);
 
     #if CONFIG_ENABLED(DEVICE_FIBER_USER_DATA)
     f->user_data = 0;
     #endif
 
+    #if CONFIG_ENABLED(CODAL_FIBER_STATS)
+    memset(&f->stats, 0, sizeof(f->stats));
+    fiber_stats_runnable(f);
+    #endif
+
     tcb_configure_stack_base(f->tcb, fiber_initial_stack_base());
 
     // Add the new Fiber to the list of all fibers
@@ -173,6 +540,92 @@ Fiber *getFiberContext()
     return f;
 }
 
+/**
+  * Removes the given fiber from the list of active fibers.
+  */
+static void remove_from_fiber_list(Fiber *f)
+{
+    target_disable_irq();
+    if (fiberList == f)
+    {
+        fiberList = fiberList->next;
+    }
+    else
+    {
+        Fiber *p = fiberList;
+
+        while (p)
+        {
+            if (p->next == f)
+            {
+                p->next = f->next;
+                break;
+            }
+
+            p = p->next;
+        }
+    }
+    target_enable_irq();
+}
+
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+/**
+  * Ensures the given fiber has a dedicated stack of at least the given size, and prepares it for use.
+  * Stacks are retained when a fiber is returned to the fiber pool, so are only reallocated if too small.
+  *
+  * @param f The fiber to allocate a stack for.
+  *
+  * @param size The size of the stack in bytes, or zero to use CODAL_FIBER_STACK_SIZE.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the stack could not be allocated.
+  */
+static int allocate_fiber_stack(Fiber *f, uint32_t size)
+{
+    if (size == 0)
+        size = CODAL_FIBER_STACK_SIZE;
+
+    // Keep the stack pointer aligned to a double word, as required by the ABI.
+    size = (size + 7) & ~7;
+
+    if (f->stack_top - f->stack_bottom < size)
+    {
+        if (f->stack_bottom != 0)
+            free((void *)f->stack_bottom);
+
+        f->stack_bottom = (PROCESSOR_WORD_TYPE)device_malloc_hint(size, CODAL_FIBER_STACK_HEAP_HINT);
+
+        if (f->stack_bottom == 0)
+        {
+            f->stack_top = 0;
+            return DEVICE_NO_RESOURCES;
+        }
+
+        f->stack_top = f->stack_bottom + size;
+    }
+
+    *(uint32_t *)f->stack_bottom = CODAL_FIBER_STACK_GUARD;
+    tcb_configure_stack_base(f->tcb, f->stack_top);
+
+    return DEVICE_OK;
+}
+#endif
+
+/**
+  * Static listener for NOTIFY events, delivering them to scheduler_event().
+  */
+static void scheduler_static_event(Event evt, void *)
+{
+    scheduler_event(evt);
+}
+
+/**
+  * Static listener for scheduler ticks, delivering them to scheduler_tick().
+  */
+static void scheduler_static_tick(Event evt, void *)
+{
+    scheduler_tick(evt);
+}
+
 void codal::scheduler_init(EventModel &_messageBus)
 {
     // If we're already initialised, then nothing to do.
@@ -187,66 +640,275 @@ void codal::scheduler_init(EventModel &_messageBus)
     currentFiber = getFiberContext();
 
     // Add ourselves to the run queue.
-    queue_fiber(currentFiber, &runQueue);
+    queue_runnable_fiber(currentFiber);
 
     // Create the IDLE fiber.
     // Configure the fiber to directly enter the idle task.
     idleFiber = getFiberContext();
 
-    tcb_configure_sp(idleFiber->tcb, INITIAL_STACK_DEPTH);
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+    // The calling thread keeps the system stack, so the idle task needs a stack of its own.
+    if (allocate_fiber_stack(idleFiber, 0) != DEVICE_OK)
+        target_panic(DEVICE_OOM);
+#endif
+
+    tcb_configure_sp(idleFiber->tcb, INITIAL_STACK_DEPTH(idleFiber));
     tcb_configure_lr(idleFiber->tcb, (PROCESSOR_WORD_TYPE)&idle_task);
 
     if (messageBus)
     {
-        // Register to receive events in the NOTIFY channel - this is used to implement wait-notify semantics
-        messageBus->listen(DEVICE_ID_NOTIFY, DEVICE_EVT_ANY, scheduler_event, MESSAGE_BUS_LISTENER_IMMEDIATE);
-        messageBus->listen(DEVICE_ID_NOTIFY_ONE, DEVICE_EVT_ANY, scheduler_event, MESSAGE_BUS_LISTENER_IMMEDIATE);
-
+        // Register to receive events in the NOTIFY channel - this is used to implement wait-notify semantics,
+        // along with the scheduler tick.
+        static constexpr StaticListener schedulerListeners[] = {
+            { DEVICE_ID_NOTIFY, DEVICE_EVT_ANY, scheduler_static_event },
+            { DEVICE_ID_NOTIFY_ONE, DEVICE_EVT_ANY, scheduler_static_event },
+            { DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_TICK, scheduler_static_tick },
+        };
+
+#if !CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
         system_timer_event_every_us(SCHEDULER_TICK_PERIOD_US, DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_TICK);
-        messageBus->listen(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_TICK, scheduler_tick, MESSAGE_BUS_LISTENER_IMMEDIATE);
+#endif
+        messageBus->addStaticListeners(schedulerListeners, 3);
     }
 
     fiber_flags |= DEVICE_SCHEDULER_RUNNING;
 }
 
-REAL_TIME_FUNC
-int codal::fiber_scheduler_running()
-{
-    if (fiber_flags & DEVICE_SCHEDULER_RUNNING)
-        return 1;
+REAL_TIME_FUNC
+int codal::fiber_scheduler_running()
+{
+    if (fiber_flags & DEVICE_SCHEDULER_RUNNING)
+        return 1;
+
+    return 0;
+}
+
+/**
+  * Determines if the calling code may block, i.e. it is running on a fiber under the fiber scheduler,
+  * other than the idle fiber, and not from an interrupt handler. Code running in invoke() may block,
+  * as a fiber will be created for it if it does.
+  *
+  * @return 1 if the caller may block, 0 otherwise.
+  */
+int codal::fiber_can_block()
+{
+    if (!fiber_scheduler_running() || target_in_irq())
+        return 0;
+
+    if (currentFiber == idleFiber && !(currentFiber->flags & DEVICE_FIBER_FLAG_FOB))
+        return 0;
+
+    return 1;
+}
+
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+/**
+  * Ensures a scheduler tick is pending no later than the next time the scheduler has work to do:
+  * the wake up time of the first sleeping fiber, or the next system tick of any component that requires one.
+  *
+  * A tick that is already pending for an earlier time is left in place, and simply results in an early
+  * (but harmless) call to scheduler_tick.
+  */
+static void scheduler_update_deadline()
+{
+    bool componentTick = CodalComponent::systemTickRequired();
+    int32_t wait = -1;
+
+    target_disable_irq();
+
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+
+    if (sleepQueue)
+    {
+        // The sleep queue is ordered, so the head of the queue is always the first to wake.
+        int32_t ms = (int32_t)(sleepQueue->context - system_timer_current_time());
+        wait = ms <= 0 ? 0 : min(ms, INT32_MAX / 1000) * 1000;
+    }
+
+    if (timedWaitList)
+    {
+        int32_t ms = (int32_t)(timedWaitDeadline - system_timer_current_time());
+        int32_t due = ms <= 0 ? 0 : min(ms, INT32_MAX / 1000) * 1000;
+
+        if (wait < 0 || due < wait)
+            wait = due;
+    }
+
+    if (componentTick)
+    {
+        if (!(fiber_flags & DEVICE_SCHEDULER_COMPONENT_TICK))
+        {
+            fiber_flags |= DEVICE_SCHEDULER_COMPONENT_TICK;
+            componentTickDue = now + SCHEDULER_TICK_PERIOD_US;
+        }
+
+        int32_t due = max((int32_t)(componentTickDue - now), 0);
+
+        if (wait < 0 || due < wait)
+            wait = due;
+    }
+    else
+    {
+        fiber_flags &= ~DEVICE_SCHEDULER_COMPONENT_TICK;
+    }
+
+    if (wait >= 0)
+    {
+        CODAL_TIMESTAMP deadline = now + wait;
+
+        if (!(fiber_flags & DEVICE_SCHEDULER_TICK_PENDING) || (int32_t)(deadline - tickDeadline) < 0)
+        {
+            if (fiber_flags & DEVICE_SCHEDULER_TICK_PENDING)
+                system_timer_cancel_event(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_TICK);
+
+            if (system_timer_event_after_us(max(wait, CODAL_TIMER_MINIMUM_PERIOD), DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_TICK) == DEVICE_OK)
+            {
+                tickDeadline = deadline;
+                fiber_flags |= DEVICE_SCHEDULER_TICK_PENDING;
+            }
+        }
+    }
+
+    target_enable_irq();
+}
+#endif
+
+void codal::scheduler_tick(Event evt)
+{
+    Fiber *f = sleepQueue;
+
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+    // Our one-shot tick has now fired.
+    fiber_flags &= ~DEVICE_SCHEDULER_TICK_PENDING;
+#endif
+
+#if !CONFIG_ENABLED(LIGHTWEIGHT_EVENTS)
+    evt.timestamp /= 1000;
+#endif
+
+    // Check the sleep queue, and wake up any fibers as necessary.
+    // The queue is sorted by wake up time, so we can stop at the first fiber that isn't yet due.
+    while (f != NULL && evt.timestamp >= f->context)
+    {
+        // Wakey wakey!
+        dequeue_fiber(f);
+        queue_runnable_fiber(f);
+        fiber_stats_runnable(f);
+
+        f = sleepQueue;
+    }
+
+    // Wake up any fibers whose timed wait has expired.
+    scheduler_expire_timed_waits(evt.timestamp);
+
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+    // Raise any component system tick that is due, keeping to a regular period where possible.
+    if (fiber_flags & DEVICE_SCHEDULER_COMPONENT_TICK)
+    {
+        CODAL_TIMESTAMP now = system_timer_current_time_us();
+
+        if ((int32_t)(now - componentTickDue) >= 0)
+        {
+            componentTickDue += SCHEDULER_TICK_PERIOD_US;
+
+            if ((int32_t)(now - componentTickDue) >= 0)
+                componentTickDue = now + SCHEDULER_TICK_PERIOD_US;
+
+            Event(DEVICE_ID_COMPONENT, DEVICE_COMPONENT_EVT_SYSTEM_TICK);
+        }
+    }
+
+    scheduler_update_deadline();
+#endif
+}
+
+/**
+  * Determines if the given event should wake a fiber waiting for the given event id and value.
+  *
+  * @param notifyOneComplete Set once a fiber has been woken by a DEVICE_ID_NOTIFY_ONE event.
+  *
+  * @return 1 if the fiber should be woken, 0 otherwise.
+  */
+static int event_wakes_fiber(uint16_t id, uint16_t value, Event &evt, int &notifyOneComplete)
+{
+    // Special case for the NOTIFY_ONE channel...
+    if ((evt.source == DEVICE_ID_NOTIFY_ONE && id == DEVICE_ID_NOTIFY) && (value == DEVICE_EVT_ANY || value == evt.value))
+    {
+        if (notifyOneComplete)
+            return 0;
+
+        notifyOneComplete = 1;
+        return 1;
+    }
+
+    // Normal case.
+    return (id == DEVICE_ID_ANY || id == evt.source) && (value == DEVICE_EVT_ANY || value == evt.value);
+}
+
+/**
+  * Wakes up any fibers in the given wait queue bucket that are waiting for the given event.
+  *
+  * @param f The first fiber in the bucket.
+  *
+  * @param evt The event that has been raised.
+  *
+  * @param notifyOneComplete Set once a fiber has been woken by a DEVICE_ID_NOTIFY_ONE event.
+  */
+static void wake_waiting_fibers(Fiber *f, Event &evt, int &notifyOneComplete)
+{
+    Fiber *t;
+
+    while (f != NULL)
+    {
+        t = f->qnext;
+
+        // extract the event data this fiber is blocked on.
+        uint16_t id = f->context & 0xFFFF;
+        uint16_t value = (f->context & 0xFFFF0000) >> 16;
+
+        // Wakey wakey!
+        if (event_wakes_fiber(id, value, evt, notifyOneComplete))
+            wake_fiber(f);
 
-    return 0;
+        f = t;
+    }
 }
 
-void codal::scheduler_tick(Event evt)
+/**
+  * Wakes up any fibers in fiber_wait_for_any() that are waiting for the given event.
+  *
+  * @param evt The event that has been raised.
+  *
+  * @param notifyOneComplete Set once a fiber has been woken by a DEVICE_ID_NOTIFY_ONE event.
+  */
+static void wake_selecting_fibers(Event &evt, int &notifyOneComplete)
 {
-    Fiber *f = sleepQueue;
-    Fiber *t;
-
-#if !CONFIG_ENABLED(LIGHTWEIGHT_EVENTS)
-    evt.timestamp /= 1000;
-#endif
+    FiberSelect **p = &selectList;
 
-    // Check the sleep queue, and wake up any fibers as necessary.
-    while (f != NULL)
+    while (*p != NULL)
     {
-        t = f->qnext;
+        FiberSelect *s = *p;
+        int match = 0;
 
-        if (evt.timestamp >= f->context)
+        for (int i = 0; i < s->n && !match; i++)
+            match = event_wakes_fiber(s->filters[i].id, s->filters[i].value, evt, notifyOneComplete);
+
+        if (match)
         {
-            // Wakey wakey!
-            dequeue_fiber(f);
-            queue_fiber(f,&runQueue);
+            // Record what woke the fiber, and wake it.
+            s->evt = evt;
+            *p = s->next;
+            wake_fiber(s->fiber);
+        }
+        else
+        {
+            p = &s->next;
         }
-
-        f = t;
     }
 }
 
 void codal::scheduler_event(Event evt)
 {
-    Fiber *f = waitQueue;
-    Fiber *t;
     int notifyOneComplete = 0;
 
     // This should never happen.
@@ -256,37 +918,26 @@ void codal::scheduler_event(Event evt)
         return;
 
     // Check the wait queue, and wake up any fibers as necessary.
-    while (f != NULL)
-    {
-        t = f->qnext;
-
-        // extract the event data this fiber is blocked on.
-        uint16_t id = f->context & 0xFFFF;
-        uint16_t value = (f->context & 0xFFFF0000) >> 16;
+    // Only fibers waiting on this specific event or on a wildcard can match, so only those buckets need checking.
+    // n.b. NOTIFY_ONE events are delivered to fibers waiting on the NOTIFY channel, which may be held elsewhere.
+    int bucket = wait_queue_bucket(evt.source, evt.value);
 
-        // Special case for the NOTIFY_ONE channel...
-        if ((evt.source == DEVICE_ID_NOTIFY_ONE && id == DEVICE_ID_NOTIFY) && (value == DEVICE_EVT_ANY || value == evt.value))
-        {
-            if (!notifyOneComplete)
-            {
-                // Wakey wakey!
-                dequeue_fiber(f);
-                queue_fiber(f,&runQueue);
-                notifyOneComplete = 1;
-            }
-        }
+    if (bucket != WAIT_QUEUE_WILDCARD)
+        wake_waiting_fibers(waitQueue[bucket], evt, notifyOneComplete);
 
-        // Normal case.
-        else if ((id == DEVICE_ID_ANY || id == evt.source) && (value == DEVICE_EVT_ANY || value == evt.value))
-        {
-            // Wakey wakey!
-            dequeue_fiber(f);
-            queue_fiber(f,&runQueue);
-        }
+    if (evt.source == DEVICE_ID_NOTIFY_ONE)
+    {
+        int notifyBucket = wait_queue_bucket(DEVICE_ID_NOTIFY, evt.value);
 
-        f = t;
+        if (notifyBucket != bucket && notifyBucket != WAIT_QUEUE_WILDCARD)
+            wake_waiting_fibers(waitQueue[notifyBucket], evt, notifyOneComplete);
     }
 
+    wake_waiting_fibers(waitQueue[WAIT_QUEUE_WILDCARD], evt, notifyOneComplete);
+
+    if (selectList)
+        wake_selecting_fibers(evt, notifyOneComplete);
+
     // Unregister this event, as we've woken up all the fibers with this match.
     if (evt.source != DEVICE_ID_NOTIFY && evt.source != DEVICE_ID_NOTIFY_ONE)
         messageBus->ignore(evt.source, evt.value, scheduler_event);
@@ -309,6 +960,9 @@ static Fiber* handle_fob()
          // If we're out of memory, there's nothing we can do.
         // keep running in the context of the current thread as a best effort.
         if (forkedFiber != NULL) {
+            // The forked fiber carries on the work of the current fiber, so inherits its priority.
+            forkedFiber->priority = f->priority;
+
 #if CONFIG_ENABLED(DEVICE_FIBER_USER_DATA)
             forkedFiber->user_data = f->user_data;
             f->user_data = NULL;
@@ -337,12 +991,42 @@ void codal::fiber_sleep(unsigned long t)
     dequeue_fiber(f);
 
     // Add fiber to the sleep queue. We maintain strict ordering here to reduce lookup times.
-    queue_fiber(f, &sleepQueue);
+    queue_sleeping_fiber(f);
+
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+    // Ensure we're woken up in time.
+    scheduler_update_deadline();
+#endif
 
     // Finally, enter the scheduler.
     schedule();
 }
 
+/**
+  * Blocks the given fiber on the given event, by moving it to the wait queue.
+  */
+static void queue_waiting_fiber(Fiber *f, uint16_t id, uint16_t value)
+{
+    // Encode the event data in the context field. It's handy having a 32 bit core. :-)
+    f->context = (uint32_t)value << 16 | id;
+
+    // Remove ourselves from the run queue
+    dequeue_fiber(f);
+
+    // Add ourselves to the wait queue, indexed by the event we're waiting for.
+    queue_fiber(f, &waitQueue[wait_queue_bucket(id, value)]);
+}
+
+/**
+  * Registers to receive the given event, so we can wake up any fibers waiting for it.
+  */
+static void listen_for_waiting_fiber(uint16_t id, uint16_t value)
+{
+    // Special case for the notify channel, as we always stay registered for that.
+    if (id != DEVICE_ID_NOTIFY && id != DEVICE_ID_NOTIFY_ONE)
+        messageBus->listen(id, value, scheduler_event, MESSAGE_BUS_LISTENER_IMMEDIATE);
+}
+
 int codal::fiber_wait_for_event(uint16_t id, uint16_t value)
 {
     int ret = fiber_wake_on_event(id, value);
@@ -353,26 +1037,91 @@ int codal::fiber_wait_for_event(uint16_t id, uint16_t value)
     return ret;
 }
 
-int codal::fiber_wake_on_event(uint16_t id, uint16_t value)
+int codal::fiber_wait_for_event_timeout(uint16_t id, uint16_t value, uint32_t timeout)
 {
     if (messageBus == NULL || !fiber_scheduler_running())
         return DEVICE_NOT_SUPPORTED;
 
     Fiber *f = handle_fob();
 
-    // Encode the event data in the context field. It's handy having a 32 bit core. :-)
-    f->context = (uint32_t)value << 16 | id;
+    // Start the timer and block atomically, so that neither the event nor the timeout can be missed.
+    target_disable_irq();
+
+    if (timeout)
+        fiber_start_timed_wait(f, timeout);
+
+    queue_waiting_fiber(f, id, value);
+
+    target_enable_irq();
+
+    listen_for_waiting_fiber(id, value);
+
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+    // Ensure we're woken up in time.
+    if (timeout)
+        scheduler_update_deadline();
+#endif
+
+    schedule();
+
+    return fiber_timed_out() ? DEVICE_TIMEOUT : DEVICE_OK;
+}
+
+Event codal::fiber_wait_for_any(const EventFilter *filters, int n)
+{
+    if (messageBus == NULL || !fiber_scheduler_running() || filters == NULL || n <= 0)
+        return Event(DEVICE_ID_ANY, DEVICE_EVT_ANY, CREATE_ONLY);
+
+    // Take a copy of the filters, as our stack may be paged out while we wait.
+    FiberSelect *s = (FiberSelect *)malloc(sizeof(FiberSelect) + n * sizeof(EventFilter));
+
+    if (s == NULL)
+        return Event(DEVICE_ID_ANY, DEVICE_EVT_ANY, CREATE_ONLY);
+
+    s->filters = (EventFilter *)(s + 1);
+    s->n = n;
+    s->next = NULL;
+    memcpy(s->filters, filters, n * sizeof(EventFilter));
+
+    Fiber *f = handle_fob();
+    s->fiber = f;
+
+    // Block, and join the tail of the select list, so that NOTIFY_ONE events are shared fairly.
+    target_disable_irq();
 
-    // Remove ourselves from the run queue
     dequeue_fiber(f);
+    queue_fiber(f, &selectQueue);
+
+    FiberSelect **p = &selectList;
+    while (*p != NULL)
+        p = &(*p)->next;
+    *p = s;
+
+    target_enable_irq();
+
+    // Register to receive each of the events, so we can wake up the fiber when one happens.
+    for (int i = 0; i < n; i++)
+        listen_for_waiting_fiber(filters[i].id, filters[i].value);
+
+    schedule();
+
+    Event evt = s->evt;
+    free(s);
+
+    return evt;
+}
 
-    // Add ourselves to the sleep queue. We maintain strict ordering here to reduce lookup times.
-    queue_fiber(f, &waitQueue);
+int codal::fiber_wake_on_event(uint16_t id, uint16_t value)
+{
+    if (messageBus == NULL || !fiber_scheduler_running())
+        return DEVICE_NOT_SUPPORTED;
+
+    Fiber *f = handle_fob();
+
+    queue_waiting_fiber(f, id, value);
 
     // Register to receive this event, so we can wake up the fiber when it happens.
-    // Special case for the notify channel, as we always stay registered for that.
-    if (id != DEVICE_ID_NOTIFY && id != DEVICE_ID_NOTIFY_ONE)
-        messageBus->listen(id, value, scheduler_event, MESSAGE_BUS_LISTENER_IMMEDIATE);
+    listen_for_waiting_fiber(id, value);
 
     return DEVICE_OK;
 }
@@ -383,6 +1132,52 @@ int codal::fiber_wake_on_event(uint16_t id, uint16_t value)
 #define HAS_THREAD_USER_DATA false
 #endif
 
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+/**
+  * Entry point for functions executed by invoke() on the stack of a spare fiber.
+  *
+  * If the function blocks, the spare fiber becomes the forked child, and is recycled here on completion.
+  * Otherwise, we resume the invoking fiber, and the spare fiber is retained for the next invoke().
+  */
+static void launch_invoked_fiber(void (*ep)(void *), void *pm, int parameterised)
+{
+    if (parameterised)
+        ep(pm);
+    else
+        ((void (*)(void))ep)();
+
+    #if CONFIG_ENABLED(DEVICE_FIBER_USER_DATA)
+    currentFiber->user_data = NULL;
+    #endif
+
+    if (currentFiber->flags & DEVICE_FIBER_FLAG_CHILD)
+        release_fiber();
+
+    currentFiber->flags |= DEVICE_FIBER_FLAG_PARENT;
+    restore_register_context(currentFiber->tcb);
+}
+
+/**
+  * Prepares a spare fiber to execute the given function on its own stack on behalf of invoke().
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if no fiber could be allocated.
+  */
+static int prepare_invoked_fiber(PROCESSOR_WORD_TYPE ep, PROCESSOR_WORD_TYPE pm, int parameterised)
+{
+    if (forkedFiber == NULL)
+        forkedFiber = getFiberContext();
+
+    if (forkedFiber == NULL || allocate_fiber_stack(forkedFiber, 0) != DEVICE_OK)
+        return DEVICE_NO_RESOURCES;
+
+    tcb_configure_args(forkedFiber->tcb, ep, pm, parameterised);
+    tcb_configure_sp(forkedFiber->tcb, INITIAL_STACK_DEPTH(forkedFiber));
+    tcb_configure_lr(forkedFiber->tcb, (PROCESSOR_WORD_TYPE)&launch_invoked_fiber);
+
+    return DEVICE_OK;
+}
+#endif
+
 int codal::invoke(void (*entry_fn)(void))
 {
     // Validate our parameters.
@@ -396,7 +1191,7 @@ int codal::invoke(void (*entry_fn)(void))
     {
         // If we attempt a fork on block whilst already in a fork on block context, or if the thread 
         // already has user data set, simply launch a fiber to deal with the request and we're done.
-        create_fiber(entry_fn);
+        create_fiber(entry_fn, release_fiber, 0, currentFiber->priority);
         return DEVICE_OK;
     }
 
@@ -420,6 +1215,17 @@ int codal::invoke(void (*entry_fn)(void))
     // execute the function directly. If the code tries to block, we detect this and
     // spawn a thread to deal with it.
     currentFiber->flags |= DEVICE_FIBER_FLAG_FOB;
+
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+    // Run the function on the stack of a spare fiber. If it blocks, that fiber simply continues as the
+    // forked child. Either way, we resume from the snapshot above.
+    if (prepare_invoked_fiber((PROCESSOR_WORD_TYPE)entry_fn, 0, 0) == DEVICE_OK)
+        restore_register_context(forkedFiber->tcb);
+
+    // We're out of memory, so run the function on this fiber as a best effort.
+    currentFiber->flags &= ~DEVICE_FIBER_FLAG_FOB;
+#endif
+
     entry_fn();
     #if CONFIG_ENABLED(DEVICE_FIBER_USER_DATA)
     currentFiber->user_data = NULL;
@@ -447,7 +1253,7 @@ int codal::invoke(void (*entry_fn)(void *), void *param)
     {
         // If we attempt a fork on block whilst already in a fork on block context, or if the thread 
         // already has user data set, simply launch a fiber to deal with the request and we're done.
-        create_fiber(entry_fn, param);
+        create_fiber(entry_fn, param, release_fiber, 0, currentFiber->priority);
         return DEVICE_OK;
     }
 
@@ -471,6 +1277,17 @@ int codal::invoke(void (*entry_fn)(void *), void *param)
     // execute the function directly. If the code tries to block, we detect this and
     // spawn a thread to deal with it.
     currentFiber->flags |= DEVICE_FIBER_FLAG_FOB;
+
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+    // Run the function on the stack of a spare fiber. If it blocks, that fiber simply continues as the
+    // forked child. Either way, we resume from the snapshot above.
+    if (prepare_invoked_fiber((PROCESSOR_WORD_TYPE)entry_fn, (PROCESSOR_WORD_TYPE)param, 1) == DEVICE_OK)
+        restore_register_context(forkedFiber->tcb);
+
+    // We're out of memory, so run the function on this fiber as a best effort.
+    currentFiber->flags &= ~DEVICE_FIBER_FLAG_FOB;
+#endif
+
     entry_fn(param);
     #if CONFIG_ENABLED(DEVICE_FIBER_USER_DATA)
     currentFiber->user_data = NULL;
@@ -510,7 +1327,7 @@ void codal::launch_new_fiber_param(void (*ep)(void *), void (*cp)(void *), void
 }
 
 
-Fiber *__create_fiber(uint32_t ep, uint32_t cp, uint32_t pm, int parameterised)
+Fiber *__create_fiber(PROCESSOR_WORD_TYPE ep, PROCESSOR_WORD_TYPE cp, PROCESSOR_WORD_TYPE pm, int parameterised, uint32_t stack_size, int priority)
 {
     // Validate our parameters.
     if (ep == 0 || cp == 0)
@@ -524,30 +1341,64 @@ Fiber *__create_fiber(uint32_t ep, uint32_t cp, uint32_t pm, int parameterised)
     if (newFiber == NULL)
         return NULL;
 
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+    if (allocate_fiber_stack(newFiber, stack_size) != DEVICE_OK)
+    {
+        remove_from_fiber_list(newFiber);
+        queue_fiber(newFiber, &fiberPool);
+        return NULL;
+    }
+#else
+    (void)stack_size;
+#endif
+
     tcb_configure_args(newFiber->tcb, ep, cp, pm);
-    tcb_configure_sp(newFiber->tcb, INITIAL_STACK_DEPTH);
+    tcb_configure_sp(newFiber->tcb, INITIAL_STACK_DEPTH(newFiber));
     tcb_configure_lr(newFiber->tcb, parameterised ? (PROCESSOR_WORD_TYPE) &launch_new_fiber_param : (PROCESSOR_WORD_TYPE) &launch_new_fiber);
 
     // Add new fiber to the run queue.
-    queue_fiber(newFiber, &runQueue);
+    newFiber->priority = fiber_priority_level(priority);
+    queue_runnable_fiber(newFiber);
+    fiber_stats_runnable(newFiber);
 
     return newFiber;
 }
 
-Fiber *codal::create_fiber(void (*entry_fn)(void), void (*completion_fn)(void))
+Fiber *codal::create_fiber(void (*entry_fn)(void), void (*completion_fn)(void), uint32_t stack_size, int priority)
 {
     if (!fiber_scheduler_running())
         return NULL;
 
-    return __create_fiber((uint32_t) entry_fn, (uint32_t)completion_fn, 0, 0);
+    return __create_fiber((PROCESSOR_WORD_TYPE) entry_fn, (PROCESSOR_WORD_TYPE)completion_fn, 0, 0, stack_size, priority);
 }
 
-Fiber *codal::create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *))
+Fiber *codal::create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *), uint32_t stack_size, int priority)
 {
     if (!fiber_scheduler_running())
         return NULL;
 
-    return __create_fiber((uint32_t) entry_fn, (uint32_t)completion_fn, (uint32_t) param, 1);
+    return __create_fiber((PROCESSOR_WORD_TYPE) entry_fn, (PROCESSOR_WORD_TYPE)completion_fn, (PROCESSOR_WORD_TYPE) param, 1, stack_size, priority);
+}
+
+int codal::fiber_set_priority(Fiber *f, int priority)
+{
+    if (f == NULL || priority < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+
+    f->priority = fiber_priority_level(priority);
+
+    // If the fiber is runnable, move it to the run queue for its new priority.
+    if (runqueue_level(f->queue) >= 0)
+    {
+        dequeue_fiber(f);
+        queue_runnable_fiber(f);
+    }
+
+    target_enable_irq();
+
+    return DEVICE_OK;
 }
 
 void codal::release_fiber(void *)
@@ -567,14 +1418,12 @@ void codal::release_fiber(void)
     // Remove ourselves form the runqueue.
     dequeue_fiber(currentFiber);
 
-    // Add ourselves to the list of free fibers
-    queue_fiber(currentFiber, &fiberPool);
-
-    // limit the number of fibers in the pool
+    // limit the number of fibers in the pool.
+    // This is done before we join the pool, as we can't free the fiber (or stack) we're executing on.
     int numFree = 0;
     for (Fiber *p = fiberPool; p; p = p->qnext) {
-        if (!p->qnext && numFree > 3) {
-            p->qprev->qnext = NULL;
+        if (!p->qnext && numFree > 2) {
+            dequeue_fiber(p);
             free(p->tcb);
             free((void *)p->stack_bottom);
             memset(p, 0, sizeof(*p));
@@ -584,32 +1433,15 @@ void codal::release_fiber(void)
         numFree++;
     }
 
+    // Add ourselves to the list of free fibers
+    queue_fiber(currentFiber, &fiberPool);
+
     // Reset fiber state, to ensure it can be safely reused.
     currentFiber->flags = 0;
     tcb_configure_stack_base(currentFiber->tcb, fiber_initial_stack_base());
 
     // Remove the fiber from the list of active fibers
-    target_disable_irq();
-    if (fiberList == currentFiber)
-    {
-        fiberList = fiberList->next;
-    }
-    else
-    {
-        Fiber *p = fiberList;
-
-        while (p)
-        {
-            if (p->next == currentFiber)
-            {
-                p->next = currentFiber->next;
-                break;
-            }
-
-            p = p->next;
-        }
-    }
-    target_enable_irq();
+    remove_from_fiber_list(currentFiber);
 
     // Find something else to do!
     schedule();
@@ -617,6 +1449,23 @@ void codal::release_fiber(void)
 
 void codal::verify_stack_size(Fiber *f)
 {
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+    // Dedicated stacks are fixed in size, so all we can do is check the fiber hasn't overflowed it.
+    // The fiber that initialised the scheduler runs on the system stack, so has no guard.
+    if (f->stack_bottom != 0 && *(uint32_t *)f->stack_bottom != CODAL_FIBER_STACK_GUARD)
+        target_panic(DEVICE_STACK_OVERFLOW);
+
+#if CONFIG_ENABLED(CODAL_FIBER_STATS)
+    // We are only here when the current stack is the stack of fiber [f].
+    if (f->stack_bottom != 0)
+    {
+        uint32_t stackDepth = f->stack_top - (PROCESSOR_WORD_TYPE)get_current_sp();
+
+        if (stackDepth > f->stats.maxStackDepth)
+            f->stats.maxStackDepth = stackDepth;
+    }
+#endif
+#else
     // Ensure the stack buffer is large enough to hold the stack Reallocate if necessary.
     PROCESSOR_WORD_TYPE stackDepth;
     PROCESSOR_WORD_TYPE bufferSize;
@@ -624,6 +1473,11 @@ void codal::verify_stack_size(Fiber *f)
     // Calculate the stack depth.
     stackDepth = tcb_get_stack_base(f->tcb) - (PROCESSOR_WORD_TYPE)get_current_sp();
 
+#if CONFIG_ENABLED(CODAL_FIBER_STATS)
+    if (stackDepth > f->stats.maxStackDepth)
+        f->stats.maxStackDepth = stackDepth;
+#endif
+
     // Calculate the size of our allocated stack buffer
     bufferSize = f->stack_top - f->stack_bottom;
 
@@ -650,24 +1504,69 @@ void codal::verify_stack_size(Fiber *f)
             free((void *)f->stack_bottom);
 
         // Allocate a new one of the appropriate size.
-        f->stack_bottom = (PROCESSOR_WORD_TYPE)malloc(bufferSize);
+        f->stack_bottom = (PROCESSOR_WORD_TYPE)device_malloc_hint(bufferSize, CODAL_FIBER_STACK_HEAP_HINT);
 
         // Recalculate where the top of the stack is and we're done.
         f->stack_top = f->stack_bottom + bufferSize;
 
         currentFiber = prevCurrFiber;
     }
+#endif
 }
 
 int codal::scheduler_runqueue_empty()
 {
-    return (runQueue == NULL);
+    return (runQueueMap == 0);
 }
 
 int codal::scheduler_waitqueue_empty()
 {
-    return (waitQueue == NULL);
+    if (selectQueue != NULL)
+        return 0;
+
+    for (int i = 0; i <= WAIT_QUEUE_WILDCARD; i++)
+        if (waitQueue[i] != NULL)
+            return 0;
+
+    return 1;
+}
+
+#if CODAL_FIBER_PRIORITY_AGING > 0
+/**
+  * Protects lower priority fibers from starvation. Each time fibers of the given priority are scheduled,
+  * the lower priority levels with runnable fibers age. When a level has been passed over CODAL_FIBER_PRIORITY_AGING
+  * times, the fiber at its head is promoted one level until it has next run.
+  *
+  * @param level The highest priority level with runnable fibers.
+  *
+  * @return The priority level to schedule from.
+  */
+static int scheduler_age_runqueues(int level)
+{
+    target_disable_irq();
+
+    runQueueAge[level] = 0;
+
+    for (int l = level - 1; l >= 0; l--)
+    {
+        if (runQueue[l] == NULL)
+            continue;
+
+        if (++runQueueAge[l] >= CODAL_FIBER_PRIORITY_AGING)
+        {
+            Fiber *f = runQueue[l];
+
+            runQueueAge[l] = 0;
+            dequeue_fiber(f);
+            queue_fiber(f, &runQueue[l + 1]);
+        }
+    }
+
+    target_enable_irq();
+
+    return runqueue_highest_level();
 }
+#endif
 
 void codal::schedule()
 {
@@ -687,6 +1586,18 @@ void codal::schedule()
         currentFiber->flags |= DEVICE_FIBER_FLAG_PARENT;
         forkedFiber->flags |= DEVICE_FIBER_FLAG_CHILD;
 
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+        // invoke() runs the blocking code on the forked fiber's own stack, so we need only capture
+        // its registers. We must only do this once, as we return here again when the fiber is resumed.
+        Fiber *f = forkedFiber;
+
+        verify_stack_size(f);
+
+        // Indicate that we have completed spawning a new fiber
+        forkedFiber = NULL;
+
+        save_register_context(f->tcb);
+#else
         // Define the stack base of the forked fiber to be align with the entry point of the parent fiber
         tcb_configure_stack_base(forkedFiber->tcb, tcb_get_sp(currentFiber->tcb));
 
@@ -698,6 +1609,7 @@ void codal::schedule()
 
         // Indicate that we have completed spawning a new fiber
         forkedFiber = NULL;
+#endif
 
         // We may now be either the newly created thread, or the one that created it.
         // if the DEVICE_FIBER_FLAG_PARENT flag is still set, we're the old thread, so
@@ -710,18 +1622,35 @@ void codal::schedule()
         return;
     }
 
-    // We're in a normal scheduling context, so perform a round robin algorithm across runnable fibers.
+#if CODAL_FIBER_PRIORITY_AGING > 0
+    // A fiber promoted to avoid starvation returns to its own priority once it has run.
+    if (runqueue_level(oldFiber->queue) > oldFiber->priority)
+    {
+        dequeue_fiber(oldFiber);
+        queue_runnable_fiber(oldFiber);
+    }
+#endif
+
+    // We're in a normal scheduling context, so perform a round robin algorithm across the runnable fibers
+    // of the highest priority.
+    int level = runqueue_highest_level();
+
+#if CODAL_FIBER_PRIORITY_AGING > 0
+    if (level > 0)
+        level = scheduler_age_runqueues(level);
+#endif
+
     // OK - if we've nothing to do, then run the IDLE task (power saving sleep)
-    if (runQueue == NULL)
+    if (level < 0)
         currentFiber = idleFiber;
 
-    else if (currentFiber->queue == &runQueue)
+    else if (currentFiber->queue == &runQueue[level])
         // If the current fiber is on the run queue, round robin.
-        currentFiber = currentFiber->qnext == NULL ? runQueue : currentFiber->qnext;
+        currentFiber = currentFiber->qnext == NULL ? runQueue[level] : currentFiber->qnext;
 
     else
         // Otherwise, just pick the head of the run queue.
-        currentFiber = runQueue;
+        currentFiber = runQueue[level];
 
     if (currentFiber == idleFiber && oldFiber->flags & DEVICE_FIBER_FLAG_DO_NOT_PAGE)
     {
@@ -736,25 +1665,45 @@ void codal::schedule()
         {
             idle();
         }
-        while (runQueue == NULL);
+        while (runQueueMap == 0);
 
         // Switch to a non-idle fiber.
         // If this fiber is the same as the old one then there'll be no switching at all.
-        currentFiber = runQueue;
+        currentFiber = runQueue[runqueue_highest_level()];
     }
 
     // Swap to the context of the chosen fiber, and we're done.
     // Don't bother with the overhead of switching if there's only one fiber on the runqueue!
     if (currentFiber != oldFiber)
     {
+#if CONFIG_ENABLED(CODAL_FIBER_STATS)
+        fiber_stats_switch(oldFiber, currentFiber);
+#endif
+
+        CODAL_TRACE(CODAL_TRACE_SWITCH, 0, 0, oldFiber->trace_id);
 
         // Special case for the idle task, as we don't maintain a stack context (just to save memory).
         if (currentFiber == idleFiber)
         {
-            tcb_configure_sp(idleFiber->tcb, INITIAL_STACK_DEPTH);
+            tcb_configure_sp(idleFiber->tcb, INITIAL_STACK_DEPTH(idleFiber));
             tcb_configure_lr(idleFiber->tcb, (PROCESSOR_WORD_TYPE)&idle_task);
         }
 
+#if CONFIG_ENABLED(CODAL_FIBER_DEDICATED_STACKS)
+        // Every fiber owns its stack, so switching is just a matter of exchanging register context.
+        // As above, there is no need to preserve the context of the idle task or a released fiber.
+        if (oldFiber == idleFiber || oldFiber->queue == &fiberPool)
+            restore_register_context(currentFiber->tcb);
+
+        // Check the fiber being scheduled out hasn't overrun its stack.
+        verify_stack_size(oldFiber);
+
+        save_register_context(oldFiber->tcb);
+
+        // We return here both after saving our context, and when we are later scheduled back in.
+        if (currentFiber != oldFiber)
+            restore_register_context(currentFiber->tcb);
+#else
         // If we're returning for IDLE or our last fiber has been destroyed, we don't need to waste time
         // saving the processor context - Just swap in the new fiber, and discard changes to stack and register context.
         if (oldFiber == idleFiber || oldFiber->queue == &fiberPool)
@@ -769,6 +1718,7 @@ void codal::schedule()
             // Schedule in the new fiber.
             swap_context(oldFiber->tcb, oldFiber->stack_top, currentFiber->tcb, currentFiber->stack_top);
         }
+#endif
     }
 }
 
@@ -791,6 +1741,11 @@ void codal::idle()
         // because we enforce MESSAGE_BUS_LISTENER_IMMEDIATE for listeners placed
         // on the scheduler.
         fiber_flags &= ~DEVICE_SCHEDULER_IDLE;
+
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+        // Pick up any components that have started requiring a system tick since we last checked.
+        scheduler_update_deadline();
+#endif
         target_scheduler_idle();
     }
 }
@@ -828,10 +1783,16 @@ FiberLock::FiberLock( int initial, FiberLockMode mode )
 
 REAL_TIME_FUNC
 void FiberLock::wait()
+{
+    wait((uint32_t)0);
+}
+
+REAL_TIME_FUNC
+int FiberLock::wait(uint32_t timeout)
 {
     // If the scheduler is not running, then simply exit, as we're running monothreaded.
     if (!fiber_scheduler_running())
-        return;
+        return DEVICE_OK;
 
     target_disable_irq();
     int l = --locked;
@@ -845,12 +1806,26 @@ void FiberLock::wait()
         // it's time to spawn a new fiber...
         Fiber *f = handle_fob();
 
+        // Start the timer and block atomically, so that neither a notify() nor the timeout can be missed.
+        target_disable_irq();
+
+        if (timeout)
+            fiber_start_timed_wait(f, timeout, this);
+
         // Remove fiber from the run queue
         dequeue_fiber(f);
 
         // Add fiber to the sleep queue. We maintain strict ordering here to reduce lookup times.
         queue_fiber(f, &queue);
 
+        target_enable_irq();
+
+#if CONFIG_ENABLED(CODAL_SCHEDULER_TICKLESS)
+        // Ensure we're woken up in time.
+        if (timeout)
+            scheduler_update_deadline();
+#endif
+
         // Check if we've been raced by something running in interrupt context.
         // Note this is safe, as no IRQ can wait() and as we are non-preemptive, neither could any other fiber.
         // It is possible that and IRQ has performed a notify() operation however.
@@ -858,17 +1833,19 @@ void FiberLock::wait()
         target_disable_irq();
         if (locked < l)
         {
-            // Remove fiber from the run queue
-            dequeue_fiber(f);
-
-            // Add fiber to the sleep queue. We maintain strict ordering here to reduce lookup times.
-            queue_fiber(f, &runQueue);
+            // Put the fiber back on the run queue.
+            wake_fiber(f);
         }
         target_enable_irq();
 
         // Finally, enter the scheduler.
         schedule();
+
+        if (fiber_timed_out())
+            return DEVICE_TIMEOUT;
     }
+
+    return DEVICE_OK;
 }
 
 void FiberLock::notify()
@@ -877,10 +1854,7 @@ void FiberLock::notify()
     //DMESGF( "%d, notify(%d)", (uint32_t)this & 0xFFFF, locked );
     Fiber *f = queue;
     if (f)
-    {
-        dequeue_fiber(f);
-        queue_fiber(f, &runQueue);
-    }
+        wake_fiber(f);
 }
 
 void FiberLock::notifyAll()
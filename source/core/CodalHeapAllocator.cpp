@@ -63,53 +63,147 @@ using namespace codal;
 HeapDefinition heap[DEVICE_MAXIMUM_HEAPS] = { };
 uint8_t heap_count = 0;
 
-#if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
-// Diplays a usage summary about a given heap...
-void device_heap_print(HeapDefinition &heap)
-{
-    PROCESSOR_WORD_TYPE	blockSize;
-    PROCESSOR_WORD_TYPE	*block;
-    int         totalFreeBlock = 0;
-    int         totalUsedBlock = 0;
-
-    if (heap.heap_start == NULL)
-    {
-        DMESG("--- HEAP NOT INITIALISED ---");
-        return;
-    }
+// Counts of the ways in which device_realloc() has satisfied requests.
+static HeapReallocStatistics realloc_statistics;
 
-    DMESG("heap_start : %p", heap.heap_start);
-    DMESG("heap_end   : %p", heap.heap_end);
-    DMESG("heap_size  : %d", (int)heap.heap_end - (int)heap.heap_start);
+#if CONFIG_ENABLED(CODAL_HEAP_STATS)
+// Heap usage, maintained as memory is allocated and released.
+static HeapStatistics heap_statistics;
 
+/**
+  * Records a change in heap usage, as a block is allocated, released or resized.
+  *
+  * @param released The usable size of a block released, or 0 if none.
+  * @param allocated The usable size of a block allocated, or 0 if none. If no block was released, this counts as an allocation.
+  */
+static void heap_statistics_update(size_t released, size_t allocated)
+{
     // Disable IRQ temporarily to ensure no race conditions!
     target_disable_irq();
 
-    block = heap.heap_start;
-    while (block < heap.heap_end)
+    for (int i = 0; i < 2; i++)
     {
-        blockSize = *block & ~DEVICE_HEAP_BLOCK_FREE;
-        if (*block & DEVICE_HEAP_BLOCK_FREE)
-            DMESGN("[F:%d] ", blockSize*DEVICE_HEAP_BLOCK_SIZE);
-        else
-            DMESGN("[U:%d] ", blockSize*DEVICE_HEAP_BLOCK_SIZE);
+        size_t size = i ? allocated : released;
+        size_t limit = 16;
+        int sizeClass = 0;
 
-        if (*block & DEVICE_HEAP_BLOCK_FREE)
-            totalFreeBlock += blockSize;
-        else
-            totalUsedBlock += blockSize;
+        if (size == 0)
+            continue;
+
+        while (size > limit && sizeClass < CODAL_HEAP_STATS_SIZE_CLASSES - 1)
+        {
+            limit <<= 1;
+            sizeClass++;
+        }
 
-        block += blockSize;
+        if (i)
+        {
+            heap_statistics.liveBytes += size;
+            heap_statistics.liveBlocks++;
+            heap_statistics.sizeClasses[sizeClass]++;
+        }
+        else
+        {
+            heap_statistics.liveBytes -= size;
+            heap_statistics.liveBlocks--;
+            heap_statistics.sizeClasses[sizeClass]--;
+        }
     }
 
+    if (heap_statistics.liveBytes > heap_statistics.peakBytes)
+        heap_statistics.peakBytes = heap_statistics.liveBytes;
+
+    if (allocated && !released)
+        heap_statistics.allocations++;
+
     // Enable Interrupts
     target_enable_irq();
+}
+
+/**
+  * Determines the heap region a given block was allocated from.
+  *
+  * @return The heap, or NULL if the memory is not part of any registered heap.
+  */
+static HeapDefinition *device_heap_find(void *mem)
+{
+    PROCESSOR_WORD_TYPE	*memory = (PROCESSOR_WORD_TYPE *)mem;
+
+    for (int i=0; i < heap_count; i++)
+        if(memory > heap[i].heap_start && memory < heap[i].heap_end)
+            return &heap[i];
+
+    return NULL;
+}
+
+/**
+  * Records that a block of heap memory is now held by a RefCounted object with the given tag.
+  * Used by REF_COUNTED_INIT, and has no effect on memory outside the device heaps.
+  *
+  * @param mem The memory area, as returned by device_malloc().
+  * @param tag The DEVICE_TAG of the object.
+  */
+void device_heap_tag(void *mem, uint16_t tag)
+{
+    if (device_heap_find(mem) == NULL)
+        return;
+
+    target_disable_irq();
+    heap_statistics.tagBytes[min(tag, CODAL_HEAP_STATS_TAGS - 1)] += device_usable_size(mem);
+    target_enable_irq();
+}
+
+/**
+  * Records that a block of heap memory is no longer held by a RefCounted object with the given tag.
+  *
+  * @param mem The memory area, as returned by device_malloc().
+  * @param tag The DEVICE_TAG of the object.
+  */
+void device_heap_untag(void *mem, uint16_t tag)
+{
+    if (device_heap_find(mem) == NULL)
+        return;
 
-    DMESG("\n");
-    DMESG("mb_total_free : %d", totalFreeBlock*DEVICE_HEAP_BLOCK_SIZE);
-    DMESG("mb_total_used : %d", totalUsedBlock*DEVICE_HEAP_BLOCK_SIZE);
+    target_disable_irq();
+    heap_statistics.tagBytes[min(tag, CODAL_HEAP_STATS_TAGS - 1)] -= device_usable_size(mem);
+    target_enable_irq();
 }
 
+/**
+  * Takes a snapshot of heap usage. Counts are maintained as memory is allocated and released, but the free
+  * memory figures require a walk of the free memory in each heap, so this should not be called too often.
+  *
+  * @param stats The statistics to fill in.
+  *
+  * @return DEVICE_OK on success.
+  */
+int device_heap_statistics(HeapStatistics &stats)
+{
+    uint32_t total, largest;
+
+    target_disable_irq();
+    stats = heap_statistics;
+    target_enable_irq();
+
+    stats.freeBytes = 0;
+    stats.largestFree = 0;
+
+    for (int i=0; i < heap_count; i++)
+    {
+        device_heap_free_space_in(heap[i], total, largest);
+
+        stats.freeBytes += total;
+        if (largest > stats.largestFree)
+            stats.largestFree = largest;
+    }
+
+    stats.fragmentation = stats.freeBytes ? 100 - (uint8_t)((uint64_t)stats.largestFree * 100 / stats.freeBytes) : 0;
+
+    return DEVICE_OK;
+}
+#endif
+
+#if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
 // Diagnostics function. Displays a usage summary about all initialised heaps.
 void device_heap_print()
 {
@@ -118,6 +212,15 @@ void device_heap_print()
         DMESG("\nHEAP %d: ", i);
         device_heap_print(heap[i]);
     }
+
+#if CONFIG_ENABLED(CODAL_HEAP_STATS)
+    HeapStatistics stats;
+    device_heap_statistics(stats);
+
+    DMESG("live: %d (peak %d) in %d blocks", stats.liveBytes, stats.peakBytes, stats.liveBlocks);
+    DMESG("free: %d (largest %d, %d%% fragmented)", stats.freeBytes, stats.largestFree, stats.fragmentation);
+    DMESG("allocations: %d (%d failed)", stats.allocations, stats.failures);
+#endif
 }
 #endif
 
@@ -126,11 +229,14 @@ void device_heap_print()
   * After this is called, any future calls to malloc, new, free or delete may use the new heap.
   * The heap allocator will attempt to allocate memory from heaps in the order that they are created.
   * i.e. memory will be allocated from first heap created until it is full, then the second heap, and so on.
+  * Allocations made through device_malloc_hint() first try the heaps whose properties match the hint.
   *
   * @param start The start address of memory to use as a heap region.
   *
   * @param end The end address of memory to use as a heap region.
   *
+  * @param flags The properties of the heap region. Defaults to DEVICE_HEAP_DEFAULT_FLAGS.
+  *
   * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the heap could not be allocated.
   *
   * @note Only code that #includes DeviceHeapAllocator.h will use this heap. This includes all codal device runtime
@@ -138,7 +244,7 @@ void device_heap_print()
   * simply use the standard heap.
   */
 
-int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end)
+int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end, uint8_t flags)
 {
     HeapDefinition *h = &heap[heap_count];
 
@@ -158,9 +264,14 @@ int device_create_heap(PROCESSOR_WORD_TYPE start, PROCESSOR_WORD_TYPE end)
     // Record the dimensions of this new heap
     h->heap_start = (PROCESSOR_WORD_TYPE *)start;
     h->heap_end = (PROCESSOR_WORD_TYPE *)end;
+    h->flags = flags;
 
     // Initialise the heap as being completely empty and available for use.
-    *h->heap_start = DEVICE_HEAP_BLOCK_FREE | (((PROCESSOR_WORD_TYPE) h->heap_end - (PROCESSOR_WORD_TYPE) h->heap_start) / DEVICE_HEAP_BLOCK_SIZE);
+    if (device_heap_init(*h) != DEVICE_OK)
+    {
+        target_enable_irq();
+        return DEVICE_INVALID_PARAMETER;
+    }
 
     heap_count++;
 
@@ -183,109 +294,34 @@ uint32_t device_heap_size(uint8_t heap_index)
 }
 
 /**
-  * Attempt to allocate a given amount of memory from a given heap area.
+  * Attempt to allocate a given amount of memory from any of our configured heap areas.
   *
   * @param size The amount of memory, in bytes, to allocate.
-  * @param heap The heap to allocate memory from.
   *
   * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
   */
 REAL_TIME_FUNC
-void *device_malloc_in(size_t size, HeapDefinition &heap)
+void* device_malloc (size_t size)
 {
-    PROCESSOR_WORD_TYPE	blockSize = 0;
-    PROCESSOR_WORD_TYPE	blocksNeeded = size % DEVICE_HEAP_BLOCK_SIZE == 0 ? size / DEVICE_HEAP_BLOCK_SIZE : size / DEVICE_HEAP_BLOCK_SIZE + 1;
-    PROCESSOR_WORD_TYPE	*block;
-    PROCESSOR_WORD_TYPE	*next;
-
-    if (size <= 0)
-        return NULL;
-
-    // Account for the index block;
-    blocksNeeded++;
-
-    // Disable IRQ temporarily to ensure no race conditions!
-    target_disable_irq();
-
-    // We implement a first fit algorithm with cache to handle rapid churn...
-    // We also defragment free blocks as we search, to optimise this and future searches.
-    block = heap.heap_start;
-    while (block < heap.heap_end)
-    {
-        // If the block is used, then keep looking.
-        if(!(*block & DEVICE_HEAP_BLOCK_FREE))
-        {
-            block += *block;
-            continue;
-        }
-
-        blockSize = *block & ~DEVICE_HEAP_BLOCK_FREE;
-
-        // We have a free block. Let's see if the subsequent ones are too. If so, we can merge...
-        next = block + blockSize;
-
-        while (*next & DEVICE_HEAP_BLOCK_FREE)
-        {
-            if (next >= heap.heap_end)
-                break;
-
-            // We can merge!
-            blockSize += (*next & ~DEVICE_HEAP_BLOCK_FREE);
-            *block = blockSize | DEVICE_HEAP_BLOCK_FREE;
-
-            next = block + blockSize;
-        }
-
-        // We have a free block. Let's see if it's big enough.
-        // If so, we have a winner.
-        if (blockSize >= blocksNeeded)
-            break;
-
-        // Otherwise, keep looking...
-        block += blockSize;
-    }
-
-    // We're full!
-    if (block >= heap.heap_end)
-    {
-        target_enable_irq();
-        return NULL;
-    }
-
-    // If we're at the end of memory or have very near match then mark the whole segment as in use.
-    if (blockSize <= blocksNeeded+1 || block+blocksNeeded+1 >= heap.heap_end)
-    {
-        // Just mark the whole block as used.
-        *block &= ~DEVICE_HEAP_BLOCK_FREE;
-    }
-    else
-    {
-        // We need to split the block.
-        PROCESSOR_WORD_TYPE *splitBlock = block + blocksNeeded;
-        *splitBlock = blockSize - blocksNeeded;
-        *splitBlock |= DEVICE_HEAP_BLOCK_FREE;
-
-        *block = blocksNeeded;
-    }
-
-    // Enable Interrupts
-    target_enable_irq();
-
-    return block+1;
+    return device_malloc_hint(size, 0);
 }
 
 /**
-  * Attempt to allocate a given amount of memory from any of our configured heap areas.
+  * Attempt to allocate a given amount of memory, preferring heap areas suited to its use.
+  * Heaps with all of the properties hinted are tried first, in the order they were created, followed by the others.
+  * If DEVICE_HEAP_DMA is hinted, only heaps accessible by DMA are used.
   *
   * @param size The amount of memory, in bytes, to allocate.
   *
+  * @param hint The intended use of the memory (any of DEVICE_HEAP_FAST, DEVICE_HEAP_LARGE, DEVICE_HEAP_DMA).
+  *
   * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
   */
 REAL_TIME_FUNC
-void* device_malloc (size_t size)
+void* device_malloc_hint (size_t size, uint8_t hint)
 {
     static uint8_t initialised = 0;
-    void *p;
+    void *p = NULL;
 
     if (size <= 0)
         return NULL;
@@ -306,17 +342,31 @@ void* device_malloc (size_t size)
 #if (DEVICE_MAXIMUM_HEAPS == 1)
     p = device_malloc_in(size, heap[0]);
 #else
-    // Assign the memory from the first heap created that has space.
-    for (int i=0; i < heap_count; i++)
+    uint8_t required = hint & DEVICE_HEAP_DMA;
+
+    // Assign the memory from the first heap created that has space, trying those with all of the properties hinted
+    // first, then any others that are suitable.
+    for (int pass = 0; pass < 2 && p == NULL; pass++)
     {
-        p = device_malloc_in(size, heap[i]);
-        if (p != NULL)
-            break;
+        for (int i=0; i < heap_count; i++)
+        {
+            bool matched = (heap[i].flags & hint) == hint;
+
+            if ((heap[i].flags & required) != required || matched != (pass == 0))
+                continue;
+
+            p = device_malloc_in(size, heap[i]);
+            if (p != NULL)
+                break;
+        }
     }
 #endif
 
     if (p != NULL)
     {
+#if CONFIG_ENABLED(CODAL_HEAP_STATS)
+        heap_statistics_update(0, device_usable_size(p));
+#endif
 #if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
             DMESG("device_malloc: ALLOCATED: %d [%p]", size, p);
 #endif
@@ -324,6 +374,12 @@ void* device_malloc (size_t size)
     }
 
     // We're totally out of options (and memory!).
+#if CONFIG_ENABLED(CODAL_HEAP_STATS)
+    target_disable_irq();
+    heap_statistics.failures++;
+    target_enable_irq();
+#endif
+
 #if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
     // Keep everything transparent if we've not been initialised yet
     DMESG("device_malloc: OUT OF MEMORY [%d]", size);
@@ -345,7 +401,6 @@ REAL_TIME_FUNC
 void device_free (void *mem)
 {
     PROCESSOR_WORD_TYPE	*memory = (PROCESSOR_WORD_TYPE *)mem;
-    PROCESSOR_WORD_TYPE	*cb = memory-1;
     int i=0;
 
 #if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
@@ -364,11 +419,11 @@ void device_free (void *mem)
     {
         if(memory > heap[i].heap_start && memory < heap[i].heap_end)
         {
-            // The memory block given is part of this heap, so we can simply
-            // flag that this memory area is now free, and we're done.
-            if (*cb == 0 || *cb & DEVICE_HEAP_BLOCK_FREE)
-                target_panic(DEVICE_HEAP_ERROR);
-            *cb |= DEVICE_HEAP_BLOCK_FREE;
+            // The memory block given is part of this heap, so return it.
+#if CONFIG_ENABLED(CODAL_HEAP_STATS)
+            heap_statistics_update(device_usable_size(memory), 0);
+#endif
+            device_free_in(memory, heap[i]);
             return;
         }
     }
@@ -391,19 +446,69 @@ void* calloc (size_t num, size_t size)
     return mem;
 }
 
+/**
+  * Determines how often device_realloc() has resized blocks in place, rather than moving them.
+  *
+  * @return The realloc statistics since the device started.
+  */
+const HeapReallocStatistics &device_realloc_statistics()
+{
+    return realloc_statistics;
+}
+
+/**
+  * Resizes a previously allocated block of memory, preserving its contents.
+  * The block is resized in place where possible, and only moved if there is insufficient free memory after it.
+  *
+  * @param ptr The memory area to resize, or NULL to allocate a new area.
+  * @param size The amount of memory, in bytes, now required.
+  *
+  * @return A pointer to the resized memory, or NULL if insufficient memory is available (in which case ptr is unchanged).
+  */
 extern "C" void* device_realloc (void* ptr, size_t size)
 {
+    PROCESSOR_WORD_TYPE	*memory = (PROCESSOR_WORD_TYPE *)ptr;
+    int i=0;
+
+    // If this memory was created from a heap registered with us, first try to resize it where it is.
+    if (memory != NULL && size > 0)
+    {
+#if (DEVICE_MAXIMUM_HEAPS > 1)
+        for (i=0; i < heap_count; i++)
+#endif
+        {
+            if(memory > heap[i].heap_start && memory < heap[i].heap_end)
+            {
+                size_t oldSize = device_usable_size(ptr);
+
+                if (device_resize_in(ptr, size, heap[i]) == DEVICE_OK)
+                {
+#if CONFIG_ENABLED(CODAL_HEAP_STATS)
+                    heap_statistics_update(oldSize, device_usable_size(ptr));
+#endif
+                    if (size <= oldSize)
+                        realloc_statistics.shrunk++;
+                    else
+                        realloc_statistics.grown++;
+
+#if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
+                    DMESG("device_realloc: RESIZED: %d [%p]", size, ptr);
+#endif
+                    return ptr;
+                }
+            }
+        }
+    }
+
     void *mem = malloc(size);
 
     // handle the simplest case - no previous memory allocted.
     if (ptr != NULL && mem != NULL)
     {
+        realloc_statistics.moved++;
 
         // Otherwise we need to copy and free up the old data.
-        PROCESSOR_WORD_TYPE *cb = ((PROCESSOR_WORD_TYPE *)ptr) - 1;
-        PROCESSOR_WORD_TYPE blockSize = *cb & ~DEVICE_HEAP_BLOCK_FREE;
-
-        memcpy(mem, ptr, min(blockSize * sizeof(PROCESSOR_WORD_TYPE), size));
+        memcpy(mem, ptr, min(device_usable_size(ptr), size));
         free(ptr);
     }
 
@@ -427,3 +532,29 @@ void _free_r(struct _reent *, void *addr)
 }
 
 #endif
+
+#if !CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR) || !CONFIG_ENABLED(CODAL_HEAP_STATS)
+/**
+  * Heap statistics are only maintained by the device heap allocator, with CODAL_HEAP_STATS enabled.
+  *
+  * @return DEVICE_NOT_SUPPORTED.
+  */
+int device_heap_statistics(HeapStatistics &)
+{
+    return DEVICE_NOT_SUPPORTED;
+}
+#endif
+
+#if !CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR)
+/**
+  * Without the device heap allocator there is only one heap, so hints are ignored.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
+  */
+extern "C" void* device_malloc_hint(size_t size, uint8_t)
+{
+    return malloc(size);
+}
+#endif
@@ -0,0 +1,339 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * The first fit allocation policy for CodalHeapAllocator.
+  *
+  * Each block is preceded by a single word, holding the size of the block in words (including that word), with the
+  * top bit set if the block is free. Allocation walks the heap from its start, merging adjacent free blocks as it
+  * goes, and takes the first block large enough. Simple and compact, but allocation time grows with the number of
+  * blocks in the heap.
+  */
+
+#include "CodalConfig.h"
+#include "CodalHeapAllocator.h"
+#include "platform_includes.h"
+#include "codal_target_hal.h"
+#include "CodalDmesg.h"
+#include "ErrorNo.h"
+
+#if CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR) && !CONFIG_ENABLED(CODAL_HEAP_TLSF)
+
+#if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
+// Diplays a usage summary about a given heap...
+void device_heap_print(HeapDefinition &heap)
+{
+    PROCESSOR_WORD_TYPE	blockSize;
+    PROCESSOR_WORD_TYPE	*block;
+    int         totalFreeBlock = 0;
+    int         totalUsedBlock = 0;
+
+    if (heap.heap_start == NULL)
+    {
+        DMESG("--- HEAP NOT INITIALISED ---");
+        return;
+    }
+
+    DMESG("heap_start : %p", heap.heap_start);
+    DMESG("heap_end   : %p", heap.heap_end);
+    DMESG("heap_size  : %d", (int)heap.heap_end - (int)heap.heap_start);
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    block = heap.heap_start;
+    while (block < heap.heap_end)
+    {
+        blockSize = *block & ~DEVICE_HEAP_BLOCK_FREE;
+        if (*block & DEVICE_HEAP_BLOCK_FREE)
+            DMESGN("[F:%d] ", blockSize*DEVICE_HEAP_BLOCK_SIZE);
+        else
+            DMESGN("[U:%d] ", blockSize*DEVICE_HEAP_BLOCK_SIZE);
+
+        if (*block & DEVICE_HEAP_BLOCK_FREE)
+            totalFreeBlock += blockSize;
+        else
+            totalUsedBlock += blockSize;
+
+        block += blockSize;
+    }
+
+    // Enable Interrupts
+    target_enable_irq();
+
+    DMESG("\n");
+    DMESG("mb_total_free : %d", totalFreeBlock*DEVICE_HEAP_BLOCK_SIZE);
+    DMESG("mb_total_used : %d", totalUsedBlock*DEVICE_HEAP_BLOCK_SIZE);
+}
+#endif
+
+/**
+  * Initialises the memory of the given heap region as completely free.
+  *
+  * @param heap The heap to initialise.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the region is too small.
+  */
+int device_heap_init(HeapDefinition &heap)
+{
+    // Initialise the heap as being completely empty and available for use.
+    *heap.heap_start = DEVICE_HEAP_BLOCK_FREE | (((PROCESSOR_WORD_TYPE) heap.heap_end - (PROCESSOR_WORD_TYPE) heap.heap_start) / DEVICE_HEAP_BLOCK_SIZE);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Attempt to allocate a given amount of memory from a given heap area.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  * @param heap The heap to allocate memory from.
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
+  */
+REAL_TIME_FUNC
+void *device_malloc_in(size_t size, HeapDefinition &heap)
+{
+    PROCESSOR_WORD_TYPE	blockSize = 0;
+    PROCESSOR_WORD_TYPE	blocksNeeded = size % DEVICE_HEAP_BLOCK_SIZE == 0 ? size / DEVICE_HEAP_BLOCK_SIZE : size / DEVICE_HEAP_BLOCK_SIZE + 1;
+    PROCESSOR_WORD_TYPE	*block;
+    PROCESSOR_WORD_TYPE	*next;
+
+    if (size <= 0)
+        return NULL;
+
+    // Account for the index block;
+    blocksNeeded++;
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    // We implement a first fit algorithm with cache to handle rapid churn...
+    // We also defragment free blocks as we search, to optimise this and future searches.
+    block = heap.heap_start;
+    while (block < heap.heap_end)
+    {
+        // If the block is used, then keep looking.
+        if(!(*block & DEVICE_HEAP_BLOCK_FREE))
+        {
+            block += *block;
+            continue;
+        }
+
+        blockSize = *block & ~DEVICE_HEAP_BLOCK_FREE;
+
+        // We have a free block. Let's see if the subsequent ones are too. If so, we can merge...
+        next = block + blockSize;
+
+        while (next < heap.heap_end && (*next & DEVICE_HEAP_BLOCK_FREE))
+        {
+            // We can merge!
+            blockSize += (*next & ~DEVICE_HEAP_BLOCK_FREE);
+            *block = blockSize | DEVICE_HEAP_BLOCK_FREE;
+
+            next = block + blockSize;
+        }
+
+        // We have a free block. Let's see if it's big enough.
+        // If so, we have a winner.
+        if (blockSize >= blocksNeeded)
+            break;
+
+        // Otherwise, keep looking...
+        block += blockSize;
+    }
+
+    // We're full!
+    if (block >= heap.heap_end)
+    {
+        target_enable_irq();
+        return NULL;
+    }
+
+    // If we're at the end of memory or have very near match then mark the whole segment as in use.
+    if (blockSize <= blocksNeeded+1 || block+blocksNeeded+1 >= heap.heap_end)
+    {
+        // Just mark the whole block as used.
+        *block &= ~DEVICE_HEAP_BLOCK_FREE;
+    }
+    else
+    {
+        // We need to split the block.
+        PROCESSOR_WORD_TYPE *splitBlock = block + blocksNeeded;
+        *splitBlock = blockSize - blocksNeeded;
+        *splitBlock |= DEVICE_HEAP_BLOCK_FREE;
+
+        *block = blocksNeeded;
+    }
+
+    // Enable Interrupts
+    target_enable_irq();
+
+    return block+1;
+}
+
+/**
+  * Release a given area of memory to the given heap area, from which it was allocated.
+  *
+  * @param mem The memory area to release.
+  * @param heap The heap the memory was allocated from.
+  */
+REAL_TIME_FUNC
+void device_free_in(void *mem, HeapDefinition &)
+{
+    PROCESSOR_WORD_TYPE	*cb = (PROCESSOR_WORD_TYPE *)mem - 1;
+
+    // Simply flag that this memory area is now free, and we're done.
+    if (*cb == 0 || *cb & DEVICE_HEAP_BLOCK_FREE)
+        target_panic(DEVICE_HEAP_ERROR);
+
+    *cb |= DEVICE_HEAP_BLOCK_FREE;
+}
+
+/**
+  * Attempt to resize a block allocated from a given heap area, without moving it.
+  * A block is shrunk by splitting off its tail as a free block, and grown by absorbing the free blocks that follow it.
+  *
+  * @param mem The memory area to resize, as returned by device_malloc_in().
+  * @param size The amount of memory, in bytes, now required.
+  * @param heap The heap the memory was allocated from.
+  *
+  * @return DEVICE_OK if the block now holds at least size bytes, or DEVICE_NO_RESOURCES if it cannot be resized in place.
+  */
+REAL_TIME_FUNC
+int device_resize_in(void *mem, size_t size, HeapDefinition &heap)
+{
+    PROCESSOR_WORD_TYPE	*cb = (PROCESSOR_WORD_TYPE *)mem - 1;
+    PROCESSOR_WORD_TYPE	blocksNeeded = size % DEVICE_HEAP_BLOCK_SIZE == 0 ? size / DEVICE_HEAP_BLOCK_SIZE : size / DEVICE_HEAP_BLOCK_SIZE + 1;
+    PROCESSOR_WORD_TYPE	blockSize;
+    PROCESSOR_WORD_TYPE	*next;
+
+    // Account for the index block;
+    blocksNeeded++;
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    blockSize = *cb;
+
+    // If growing, absorb the free blocks that follow until we have enough space.
+    next = cb + blockSize;
+    while (blockSize < blocksNeeded && next < heap.heap_end && (*next & DEVICE_HEAP_BLOCK_FREE))
+    {
+        blockSize += (*next & ~DEVICE_HEAP_BLOCK_FREE);
+        next = cb + blockSize;
+    }
+
+    if (blockSize < blocksNeeded)
+    {
+        // Record any free blocks we merged, so later searches needn't merge them again.
+        if (blockSize > *cb)
+        {
+            *(cb + *cb) = (blockSize - *cb) | DEVICE_HEAP_BLOCK_FREE;
+        }
+
+        target_enable_irq();
+        return DEVICE_NO_RESOURCES;
+    }
+
+    // Split off any space we don't need, unless it is a very near match (as per device_malloc_in).
+    if (blockSize > blocksNeeded+1)
+    {
+        *(cb + blocksNeeded) = (blockSize - blocksNeeded) | DEVICE_HEAP_BLOCK_FREE;
+        blockSize = blocksNeeded;
+    }
+
+    *cb = blockSize;
+
+    // Enable Interrupts
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+  * Measures the free memory in a given heap area. Adjacent free blocks are counted as one, as they are
+  * merged when next allocated from.
+  *
+  * @param heap The heap to measure.
+  * @param total Set to the total number of bytes free.
+  * @param largest Set to the size of the largest block that could be allocated.
+  */
+void device_heap_free_space_in(HeapDefinition &heap, uint32_t &total, uint32_t &largest)
+{
+    PROCESSOR_WORD_TYPE	*block;
+    PROCESSOR_WORD_TYPE	freeBlocks = 0;
+
+    total = 0;
+    largest = 0;
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    block = heap.heap_start;
+    while (block <= heap.heap_end)
+    {
+        if (block < heap.heap_end && (*block & DEVICE_HEAP_BLOCK_FREE))
+        {
+            freeBlocks += *block & ~DEVICE_HEAP_BLOCK_FREE;
+            block += *block & ~DEVICE_HEAP_BLOCK_FREE;
+            continue;
+        }
+
+        // The end of a run of free blocks, which would be merged into one block with a single index word.
+        if (freeBlocks > 1)
+        {
+            uint32_t size = (freeBlocks - 1) * DEVICE_HEAP_BLOCK_SIZE;
+
+            total += size;
+            if (size > largest)
+                largest = size;
+        }
+
+        if (block == heap.heap_end)
+            break;
+
+        freeBlocks = 0;
+        block += *block;
+    }
+
+    // Enable Interrupts
+    target_enable_irq();
+}
+
+/**
+  * Determines the number of bytes that may be used in a block allocated from a heap area.
+  *
+  * @param mem The memory area, as returned by device_malloc_in().
+  *
+  * @return The usable size of the block, which is at least the size requested.
+  */
+size_t device_usable_size(void *mem)
+{
+    PROCESSOR_WORD_TYPE	*cb = (PROCESSOR_WORD_TYPE *)mem - 1;
+
+    // The block size includes the index block.
+    return ((*cb & ~DEVICE_HEAP_BLOCK_FREE) - 1) * DEVICE_HEAP_BLOCK_SIZE;
+}
+
+#endif
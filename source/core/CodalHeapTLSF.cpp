@@ -0,0 +1,537 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * The two level segregated fit (TLSF) allocation policy for CodalHeapAllocator.
+  *
+  * Free blocks are held in lists segregated by size. A first level divides sizes into powers of two, and a second
+  * level divides each power of two into 2^CODAL_HEAP_TLSF_SL_LOG2 equal ranges. Bitmaps record which lists are
+  * non-empty, so a suitable free block is found with a couple of bit scans, rather than a walk of the heap. Freed
+  * blocks are merged with their free neighbours immediately, using a pointer to the previous physical block kept
+  * in the last word of each free block. Allocation and release therefore take constant time, however full the heap.
+  *
+  * The index of free lists is held at the start of each heap region.
+  */
+
+#include "CodalConfig.h"
+#include "CodalHeapAllocator.h"
+#include "platform_includes.h"
+#include "codal_target_hal.h"
+#include "CodalDmesg.h"
+#include "ErrorNo.h"
+
+#if CONFIG_ENABLED(DEVICE_HEAP_ALLOCATOR) && CONFIG_ENABLED(CODAL_HEAP_TLSF)
+
+#define TLSF_ALIGN              sizeof(PROCESSOR_WORD_TYPE)
+#define TLSF_ALIGN_LOG2         (sizeof(PROCESSOR_WORD_TYPE) == 8 ? 3 : 2)
+
+#define TLSF_SL_COUNT           (1 << CODAL_HEAP_TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT           (CODAL_HEAP_TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_FL_COUNT           (CODAL_HEAP_TLSF_FL_INDEX_MAX - TLSF_FL_SHIFT + 1)
+#define TLSF_SMALL_BLOCK_SIZE   ((size_t)1 << TLSF_FL_SHIFT)
+
+// Flags held in the low bits of the size of each block.
+#define TLSF_BLOCK_FREE         0x01
+#define TLSF_BLOCK_PREV_FREE    0x02
+#define TLSF_BLOCK_FLAGS        (TLSF_BLOCK_FREE | TLSF_BLOCK_PREV_FREE)
+
+/**
+  * The header of a block. The payload of a used block begins at nextFree, so only the size is overhead.
+  * prevPhysical is held in the last word of the previous block, and is only valid if that block is free.
+  */
+struct TLSFBlock
+{
+    TLSFBlock   *prevPhysical;      // The previous block in memory, if it is free.
+    size_t      size;               // The size of the payload of this block, in bytes, and its flags.
+    TLSFBlock   *nextFree;          // The next block in this block's free list, if it is free.
+    TLSFBlock   *prevFree;          // The previous block in this block's free list, if it is free.
+};
+
+#define TLSF_BLOCK_OVERHEAD     sizeof(size_t)
+#define TLSF_BLOCK_PAYLOAD      (sizeof(TLSFBlock *) + sizeof(size_t))
+#define TLSF_BLOCK_SIZE_MIN     (sizeof(TLSFBlock) - sizeof(TLSFBlock *))
+
+/**
+  * The index of free blocks, held at the start of each heap region.
+  */
+struct TLSFControl
+{
+    uint32_t    flBitmap;                                   // Which first level lists hold free blocks.
+    uint32_t    slBitmap[TLSF_FL_COUNT];                    // Which second level lists hold free blocks.
+    TLSFBlock   *blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];      // The free lists.
+};
+
+static inline size_t block_size(TLSFBlock *b)
+{
+    return b->size & ~TLSF_BLOCK_FLAGS;
+}
+
+static inline void *block_to_ptr(TLSFBlock *b)
+{
+    return (uint8_t *)b + TLSF_BLOCK_PAYLOAD;
+}
+
+static inline TLSFBlock *block_from_ptr(void *p)
+{
+    return (TLSFBlock *)((uint8_t *)p - TLSF_BLOCK_PAYLOAD);
+}
+
+static inline TLSFBlock *block_next(TLSFBlock *b)
+{
+    return (TLSFBlock *)((uint8_t *)block_to_ptr(b) + block_size(b) - TLSF_BLOCK_OVERHEAD);
+}
+
+static inline int tlsf_fls(size_t x)
+{
+    return sizeof(unsigned long) * 8 - 1 - __builtin_clzl(x);
+}
+
+/**
+  * Determines the free list a block of the given size belongs to.
+  */
+static inline void mapping_insert(size_t size, int &fl, int &sl)
+{
+    if (size < TLSF_SMALL_BLOCK_SIZE)
+    {
+        fl = 0;
+        sl = size / (TLSF_SMALL_BLOCK_SIZE / TLSF_SL_COUNT);
+        return;
+    }
+
+    fl = tlsf_fls(size);
+    sl = (size >> (fl - CODAL_HEAP_TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+    fl -= TLSF_FL_SHIFT - 1;
+
+    // Blocks larger than the first level index can describe all share the last list.
+    if (fl >= TLSF_FL_COUNT)
+    {
+        fl = TLSF_FL_COUNT - 1;
+        sl = TLSF_SL_COUNT - 1;
+    }
+}
+
+/**
+  * Determines the first free list in which every block is at least the given size.
+  */
+static inline void mapping_search(size_t size, int &fl, int &sl)
+{
+    if (size >= TLSF_SMALL_BLOCK_SIZE)
+        size += ((size_t)1 << (tlsf_fls(size) - CODAL_HEAP_TLSF_SL_LOG2)) - 1;
+
+    mapping_insert(size, fl, sl);
+}
+
+static void insert_free_block(TLSFControl *control, TLSFBlock *b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), fl, sl);
+
+    TLSFBlock *head = control->blocks[fl][sl];
+
+    b->nextFree = head;
+    b->prevFree = NULL;
+
+    if (head)
+        head->prevFree = b;
+
+    control->blocks[fl][sl] = b;
+    control->flBitmap |= 1UL << fl;
+    control->slBitmap[fl] |= 1UL << sl;
+}
+
+static void remove_free_block(TLSFControl *control, TLSFBlock *b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), fl, sl);
+
+    if (b->nextFree)
+        b->nextFree->prevFree = b->prevFree;
+
+    if (b->prevFree)
+        b->prevFree->nextFree = b->nextFree;
+    else
+    {
+        control->blocks[fl][sl] = b->nextFree;
+
+        if (b->nextFree == NULL)
+        {
+            control->slBitmap[fl] &= ~(1UL << sl);
+
+            if (control->slBitmap[fl] == 0)
+                control->flBitmap &= ~(1UL << fl);
+        }
+    }
+}
+
+/**
+  * Finds a free block of at least the given size in the list that a block of that size would be inserted into.
+  * Blocks in this list may be smaller than the request, so this is only used once the bitmaps have failed.
+  */
+static TLSFBlock *search_insert_list(TLSFControl *control, size_t size)
+{
+    int fl, sl;
+    mapping_insert(size, fl, sl);
+
+    TLSFBlock *b = control->blocks[fl][sl];
+
+    while (b != NULL && block_size(b) < size)
+        b = b->nextFree;
+
+    return b;
+}
+
+/**
+  * Finds a free block of at least the given size, using the bitmaps to find the first suitable non-empty list.
+  * If there is none, the list holding blocks of a similar size is searched before the request is failed.
+  */
+static TLSFBlock *search_suitable_block(TLSFControl *control, size_t size)
+{
+    int fl, sl;
+    mapping_search(size, fl, sl);
+
+    uint32_t slMap = control->slBitmap[fl] & (~0UL << sl);
+
+    if (slMap == 0)
+    {
+        uint32_t flMap = fl + 1 < TLSF_FL_COUNT ? control->flBitmap & (~0UL << (fl + 1)) : 0;
+
+        if (flMap == 0)
+            return search_insert_list(control, size);
+
+        fl = __builtin_ctz(flMap);
+        slMap = control->slBitmap[fl];
+    }
+
+    sl = __builtin_ctz(slMap);
+
+    TLSFBlock *b = control->blocks[fl][sl];
+
+    // The last list holds blocks of any larger size, so is not guaranteed to satisfy the request.
+    if (fl == TLSF_FL_COUNT - 1 && sl == TLSF_SL_COUNT - 1)
+        while (b != NULL && block_size(b) < size)
+            b = b->nextFree;
+
+    return b;
+}
+
+/**
+  * Rounds a requested size up to one that can be held in a block.
+  */
+static inline size_t adjust_size(size_t size)
+{
+    size = (size + TLSF_ALIGN - 1) & ~(TLSF_ALIGN - 1);
+
+    return size < TLSF_BLOCK_SIZE_MIN ? TLSF_BLOCK_SIZE_MIN : size;
+}
+
+/**
+  * Reduces a used block to the given size, if the remainder is large enough to hold a block of its own.
+  * The remainder is merged with the following block if that is free, and returned to the free lists.
+  */
+static void block_trim(TLSFControl *control, TLSFBlock *b, size_t size)
+{
+    if (block_size(b) < size + TLSF_BLOCK_SIZE_MIN + TLSF_BLOCK_OVERHEAD)
+        return;
+
+    TLSFBlock *remainder = (TLSFBlock *)((uint8_t *)block_to_ptr(b) + size - TLSF_BLOCK_OVERHEAD);
+    remainder->size = (block_size(b) - size - TLSF_BLOCK_OVERHEAD) | TLSF_BLOCK_FREE;
+    b->size = size | (b->size & TLSF_BLOCK_PREV_FREE);
+
+    TLSFBlock *next = block_next(remainder);
+
+    if (next->size & TLSF_BLOCK_FREE)
+    {
+        remove_free_block(control, next);
+        remainder->size += block_size(next) + TLSF_BLOCK_OVERHEAD;
+        next = block_next(remainder);
+    }
+
+    next->prevPhysical = remainder;
+    next->size |= TLSF_BLOCK_PREV_FREE;
+
+    insert_free_block(control, remainder);
+}
+
+/**
+  * Initialises the memory of the given heap region as completely free.
+  *
+  * @param heap The heap to initialise.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the region is too small.
+  */
+int device_heap_init(HeapDefinition &heap)
+{
+    TLSFControl *control = (TLSFControl *)heap.heap_start;
+    uint8_t *pool = (uint8_t *)heap.heap_start + ((sizeof(TLSFControl) + TLSF_ALIGN - 1) & ~(TLSF_ALIGN - 1));
+    uint8_t *end = (uint8_t *)heap.heap_end;
+
+    // We need room for the index, one minimal block, and the sentinel block that marks the end of the heap.
+    if (end < pool || (size_t)(end - pool) < TLSF_BLOCK_SIZE_MIN + 2 * TLSF_BLOCK_OVERHEAD)
+        return DEVICE_INVALID_PARAMETER;
+
+    memset(control, 0, sizeof(TLSFControl));
+
+    // The first block's prevPhysical would precede the pool, so overlaps the index. It is never used, as there is
+    // no previous block.
+    TLSFBlock *b = (TLSFBlock *)(pool - sizeof(TLSFBlock *));
+    b->size = ((end - pool - 2 * TLSF_BLOCK_OVERHEAD) & ~(TLSF_ALIGN - 1)) | TLSF_BLOCK_FREE;
+    insert_free_block(control, b);
+
+    // A zero sized, used block marks the end of the heap, so that we never merge beyond it.
+    TLSFBlock *sentinel = block_next(b);
+    sentinel->prevPhysical = b;
+    sentinel->size = TLSF_BLOCK_PREV_FREE;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Attempt to allocate a given amount of memory from a given heap area.
+  *
+  * @param size The amount of memory, in bytes, to allocate.
+  * @param heap The heap to allocate memory from.
+  *
+  * @return A pointer to the allocated memory, or NULL if insufficient memory is available.
+  */
+REAL_TIME_FUNC
+void *device_malloc_in(size_t size, HeapDefinition &heap)
+{
+    TLSFControl *control = (TLSFControl *)heap.heap_start;
+
+    if (size == 0 || size > (size_t)((uint8_t *)heap.heap_end - (uint8_t *)heap.heap_start))
+        return NULL;
+
+    size = adjust_size(size);
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    TLSFBlock *b = search_suitable_block(control, size);
+
+    if (b == NULL)
+    {
+        target_enable_irq();
+        return NULL;
+    }
+
+    remove_free_block(control, b);
+
+    b->size &= ~TLSF_BLOCK_FREE;
+    block_next(b)->size &= ~TLSF_BLOCK_PREV_FREE;
+
+    block_trim(control, b, size);
+
+    // Enable Interrupts
+    target_enable_irq();
+
+    return block_to_ptr(b);
+}
+
+/**
+  * Release a given area of memory to the given heap area, from which it was allocated.
+  *
+  * @param mem The memory area to release.
+  * @param heap The heap the memory was allocated from.
+  */
+REAL_TIME_FUNC
+void device_free_in(void *mem, HeapDefinition &heap)
+{
+    TLSFControl *control = (TLSFControl *)heap.heap_start;
+    TLSFBlock *b = block_from_ptr(mem);
+
+    if (b->size & TLSF_BLOCK_FREE)
+        target_panic(DEVICE_HEAP_ERROR);
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    // Merge with the previous block, if it is free.
+    if (b->size & TLSF_BLOCK_PREV_FREE)
+    {
+        TLSFBlock *prev = b->prevPhysical;
+        remove_free_block(control, prev);
+
+        prev->size += block_size(b) + TLSF_BLOCK_OVERHEAD;
+        b = prev;
+    }
+
+    // Merge with the next block, if it is free.
+    TLSFBlock *next = block_next(b);
+
+    if (next->size & TLSF_BLOCK_FREE)
+    {
+        remove_free_block(control, next);
+        b->size += block_size(next) + TLSF_BLOCK_OVERHEAD;
+        next = block_next(b);
+    }
+
+    b->size |= TLSF_BLOCK_FREE;
+    next->prevPhysical = b;
+    next->size |= TLSF_BLOCK_PREV_FREE;
+
+    insert_free_block(control, b);
+
+    // Enable Interrupts
+    target_enable_irq();
+}
+
+/**
+  * Attempt to resize a block allocated from a given heap area, without moving it.
+  * A block is shrunk by splitting off its tail as a free block, and grown by absorbing the block that follows it, if free.
+  *
+  * @param mem The memory area to resize, as returned by device_malloc_in().
+  * @param size The amount of memory, in bytes, now required.
+  * @param heap The heap the memory was allocated from.
+  *
+  * @return DEVICE_OK if the block now holds at least size bytes, or DEVICE_NO_RESOURCES if it cannot be resized in place.
+  */
+REAL_TIME_FUNC
+int device_resize_in(void *mem, size_t size, HeapDefinition &heap)
+{
+    TLSFControl *control = (TLSFControl *)heap.heap_start;
+    TLSFBlock *b = block_from_ptr(mem);
+
+    if (size > (size_t)((uint8_t *)heap.heap_end - (uint8_t *)heap.heap_start))
+        return DEVICE_NO_RESOURCES;
+
+    size = adjust_size(size);
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    if (block_size(b) < size)
+    {
+        TLSFBlock *next = block_next(b);
+
+        if (!(next->size & TLSF_BLOCK_FREE) || block_size(b) + TLSF_BLOCK_OVERHEAD + block_size(next) < size)
+        {
+            target_enable_irq();
+            return DEVICE_NO_RESOURCES;
+        }
+
+        remove_free_block(control, next);
+        b->size += block_size(next) + TLSF_BLOCK_OVERHEAD;
+        block_next(b)->size &= ~TLSF_BLOCK_PREV_FREE;
+    }
+
+    block_trim(control, b, size);
+
+    // Enable Interrupts
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+  * Measures the free memory in a given heap area.
+  *
+  * @param heap The heap to measure.
+  * @param total Set to the total number of bytes free.
+  * @param largest Set to the size of the largest block that could be allocated.
+  */
+void device_heap_free_space_in(HeapDefinition &heap, uint32_t &total, uint32_t &largest)
+{
+    TLSFControl *control = (TLSFControl *)heap.heap_start;
+
+    total = 0;
+    largest = 0;
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    // Free blocks are always merged with their neighbours, so each free block stands alone.
+    for (int fl = 0; fl < TLSF_FL_COUNT; fl++)
+    {
+        if (!(control->flBitmap & (1UL << fl)))
+            continue;
+
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++)
+            for (TLSFBlock *b = control->blocks[fl][sl]; b != NULL; b = b->nextFree)
+            {
+                total += block_size(b);
+                if (block_size(b) > largest)
+                    largest = block_size(b);
+            }
+    }
+
+    // Enable Interrupts
+    target_enable_irq();
+}
+
+/**
+  * Determines the number of bytes that may be used in a block allocated from a heap area.
+  *
+  * @param mem The memory area, as returned by device_malloc_in().
+  *
+  * @return The usable size of the block, which is at least the size requested.
+  */
+size_t device_usable_size(void *mem)
+{
+    return block_size(block_from_ptr(mem));
+}
+
+#if (CODAL_DEBUG >= CODAL_DEBUG_HEAP)
+/**
+  * Displays a usage summary about a given heap.
+  */
+void device_heap_print(HeapDefinition &heap)
+{
+    int totalFree = 0;
+    int totalUsed = 0;
+
+    if (heap.heap_start == NULL)
+    {
+        DMESG("--- HEAP NOT INITIALISED ---");
+        return;
+    }
+
+    DMESG("heap_start : %p", heap.heap_start);
+    DMESG("heap_end   : %p", heap.heap_end);
+    DMESG("heap_size  : %d", (int)heap.heap_end - (int)heap.heap_start);
+
+    // Disable IRQ temporarily to ensure no race conditions!
+    target_disable_irq();
+
+    uint8_t *pool = (uint8_t *)heap.heap_start + ((sizeof(TLSFControl) + TLSF_ALIGN - 1) & ~(TLSF_ALIGN - 1));
+
+    for (TLSFBlock *b = (TLSFBlock *)(pool - sizeof(TLSFBlock *)); block_size(b) > 0; b = block_next(b))
+    {
+        DMESGN("[%c:%d] ", b->size & TLSF_BLOCK_FREE ? 'F' : 'U', block_size(b));
+
+        if (b->size & TLSF_BLOCK_FREE)
+            totalFree += block_size(b);
+        else
+            totalUsed += block_size(b);
+    }
+
+    // Enable Interrupts
+    target_enable_irq();
+
+    DMESG("\n");
+    DMESG("mb_total_free : %d", totalFree);
+    DMESG("mb_total_used : %d", totalUsed);
+}
+#endif
+
+#endif
@@ -29,9 +29,30 @@ DEALINGS IN THE SOFTWARE.
   */
 #include "CodalConfig.h"
 #include "CodalListener.h"
+#include "CodalSlab.h"
+#include "ErrorNo.h"
 
 using namespace codal;
 
+#if CODAL_LISTENER_SLAB_SIZE > 0
+static uint64_t listenerSlabStorage[CODAL_SLAB_STORAGE(sizeof(Listener), CODAL_LISTENER_SLAB_SIZE)];
+static CodalSlab listenerSlab = { listenerSlabStorage, CODAL_SLAB_SLOT_SIZE(sizeof(Listener)), CODAL_LISTENER_SLAB_SIZE };
+#else
+static CodalSlab listenerSlab = { NULL, 0, 0 };
+#endif
+
+#define LISTENER_QUEUE_BYTES ((sizeof(Event) + 1) * MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH)
+
+// The number of events merged into each queued event is held after the events themselves.
+#define LISTENER_QUEUE_MERGED(q) ((uint8_t *)((q) + MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH))
+
+#if CODAL_LISTENER_QUEUE_SLAB_SIZE > 0
+static uint64_t listenerQueueSlabStorage[CODAL_SLAB_STORAGE(LISTENER_QUEUE_BYTES, CODAL_LISTENER_QUEUE_SLAB_SIZE)];
+static CodalSlab listenerQueueSlab = { listenerQueueSlabStorage, CODAL_SLAB_SLOT_SIZE(LISTENER_QUEUE_BYTES), CODAL_LISTENER_QUEUE_SLAB_SIZE };
+#else
+static CodalSlab listenerQueueSlab = { NULL, 0, 0 };
+#endif
+
 /**
   * Constructor.
   *
@@ -55,6 +76,9 @@ Listener::Listener(uint16_t id, uint16_t value, void (*handler)(Event), uint16_t
     this->flags = flags;
 	this->next = NULL;
     this->evt_queue = NULL;
+    this->evt_queue_head = 0;
+    this->evt_queue_length = 0;
+    this->evt_merged = 0;
 }
 
 /**
@@ -83,6 +107,41 @@ Listener::Listener(uint16_t id, uint16_t value, void (*handler)(Event, void *),
     this->flags = flags | MESSAGE_BUS_LISTENER_PARAMETERISED;
 	this->next = NULL;
     this->evt_queue = NULL;
+    this->evt_queue_head = 0;
+    this->evt_queue_length = 0;
+    this->evt_merged = 0;
+}
+
+/**
+  * Constructor.
+  *
+  * Create a new Message Bus Listener that receives events in batches. Events are collected in this
+  * listener's queue, and handed to the handler together once the MessageBus has drained its own queue,
+  * or MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH events have been collected.
+  *
+  * @param id The ID of the component you want to listen to.
+  *
+  * @param value The event value you would like to listen to from that component
+  *
+  * @param handler A function pointer to call with each batch of events, and the number of events in it.
+  *
+  * @param arg A pointer to some data that will be given to the handler.
+  *
+  * @param flags User specified, implementation specific flags, that allow behaviour of this events listener
+  * to be tuned.
+  */
+Listener::Listener(uint16_t id, uint16_t value, void (*handler)(Event *, int, void *), void* arg, uint16_t flags)
+{
+    this->id = id;
+    this->value = value;
+    this->cb_batch = handler;
+    this->cb_arg = arg;
+    this->flags = flags | MESSAGE_BUS_LISTENER_BATCH;
+    this->next = NULL;
+    this->evt_queue = NULL;
+    this->evt_queue_head = 0;
+    this->evt_queue_length = 0;
+    this->evt_merged = 0;
 }
 
 /**
@@ -92,32 +151,73 @@ Listener::~Listener()
 {
     if(this->flags & MESSAGE_BUS_LISTENER_METHOD)
         delete cb_method;
+
+    listenerQueueSlab.release(evt_queue);
 }
 
 /**
   * Queues and event up to be processed.
   *
   * @param e The event to queue
+  *
+  * @param merged The number of events merged into e.
   */
-void Listener::queue(Event e)
+void Listener::queue(Event e, uint8_t merged)
 {
-    int queueDepth;
-
-    EventQueueItem *p = evt_queue;
-
+    // The queue is only allocated once, the first time this listener is busy.
     if (evt_queue == NULL)
-        evt_queue = new EventQueueItem(e);
-    else
     {
-        queueDepth = 1;
+        // Events are only ever copied into the queue, so it needs no construction.
+        evt_queue = (Event *)listenerQueueSlab.allocate(LISTENER_QUEUE_BYTES);
+
+        if (evt_queue == NULL)
+            return;
+    }
 
-        while (p->next != NULL)
-        {
-            p = p->next;
-            queueDepth++;
-        }
+    if (evt_queue_length < MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH)
+    {
+        int slot = (evt_queue_head + evt_queue_length) % MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH;
 
-        if (queueDepth < MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH)
-            p->next = new EventQueueItem(e);
+        evt_queue[slot] = e;
+        LISTENER_QUEUE_MERGED(evt_queue)[slot] = merged;
+        evt_queue_length++;
     }
 }
+
+/**
+  * Removes the oldest event queued for this listener.
+  *
+  * @param e Updated with the oldest queued event.
+  *
+  * @param merged Updated with the number of events merged into that event.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_DATA if no events are queued.
+  */
+int Listener::dequeue(Event &e, uint8_t &merged)
+{
+    if (evt_queue_length == 0)
+        return DEVICE_NO_DATA;
+
+    e = evt_queue[evt_queue_head];
+    merged = LISTENER_QUEUE_MERGED(evt_queue)[evt_queue_head];
+    evt_queue_head = (evt_queue_head + 1) % MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH;
+    evt_queue_length--;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Allocates Listeners from a fixed size pool (CODAL_LISTENER_SLAB_SIZE), falling back to the heap.
+  */
+void *Listener::operator new(size_t size)
+{
+    return listenerSlab.allocate(size);
+}
+
+/**
+  * Releases a Listener allocated by operator new.
+  */
+void Listener::operator delete(void *p)
+{
+    listenerSlab.release(p);
+}
@@ -0,0 +1,104 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * A fixed size pool of equally sized objects, for small objects that are allocated often.
+  */
+#include "CodalConfig.h"
+#include "CodalSlab.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+/**
+  * Allocates memory for an object of the given size, from this slab if possible.
+  *
+  * @param size The size of the object, in bytes.
+  *
+  * @return A pointer to the memory, or NULL if there is no memory available.
+  */
+REAL_TIME_FUNC
+void *CodalSlab::allocate(size_t size)
+{
+    void *p = NULL;
+
+    if (size <= slotSize)
+    {
+        target_disable_irq();
+
+        if (freeList != NULL)
+        {
+            p = freeList;
+            freeList = *(void **)p;
+        }
+        else if (used < count)
+        {
+            p = (uint8_t *)storage + used * slotSize;
+            used++;
+        }
+
+        if (p != NULL)
+            inUse++;
+        else
+            fallbacks++;
+
+        target_enable_irq();
+    }
+
+    if (p == NULL)
+        p = malloc(size);
+
+    return p;
+}
+
+/**
+  * Releases memory allocated by allocate(), returning it to this slab or to the heap.
+  *
+  * @param p The memory to release. May be NULL.
+  */
+REAL_TIME_FUNC
+void CodalSlab::release(void *p)
+{
+    if (!contains(p))
+    {
+        free(p);
+        return;
+    }
+
+    target_disable_irq();
+
+    *(void **)p = freeList;
+    freeList = p;
+    inUse--;
+
+    target_enable_irq();
+}
+
+/**
+  * Determines if the given memory is held within this slab.
+  */
+bool CodalSlab::contains(void *p)
+{
+    return p >= storage && p < (void *)((uint8_t *)storage + count * slotSize);
+}
@@ -0,0 +1,214 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * A lightweight, run-to-completion task queue for the Device Fiber scheduler.
+  *
+  * Queued tasks are held in a fixed ring for each fiber priority level, so queueing a task never allocates
+  * memory. A single worker fiber runs the tasks using invoke(), so a task only costs a fiber if it blocks.
+  * The worker runs at the priority of the most urgent task it has to do.
+  */
+#include "CodalConfig.h"
+#include "CodalTaskQueue.h"
+#include "ErrorNo.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+#if CODAL_TASK_QUEUE_SIZE > 0
+
+/**
+  * A task waiting to be run.
+  */
+struct TaskQueueSlot
+{
+    void (*fn)(void *);                             // The function to run.
+    void *arg;                                      // The parameter to pass to the function.
+};
+
+/**
+  * The tasks waiting to be run at one priority level.
+  */
+struct TaskQueueRing
+{
+    TaskQueueSlot slots[CODAL_TASK_QUEUE_SIZE];
+    uint8_t head;                                   // The next slot to run.
+    uint8_t length;                                 // The number of tasks queued.
+};
+
+static TaskQueueRing taskQueue[CODAL_FIBER_PRIORITY_LEVELS];
+static uint32_t taskQueueMap = 0;                   // Bitmap of the priority levels with queued tasks.
+static Fiber *taskWorker = NULL;                    // The fiber that runs queued tasks.
+static FiberLock taskCount(0, FiberLockMode::SEMAPHORE);  // Counts queued tasks, and blocks the worker when there are none.
+
+/**
+  * Determines the highest priority level with queued tasks.
+  *
+  * @return The priority level, or -1 if no tasks are queued.
+  */
+static inline int task_queue_highest_level()
+{
+    return taskQueueMap ? 31 - __builtin_clz(taskQueueMap) : -1;
+}
+
+/**
+  * Removes the most urgent task from the queue.
+  *
+  * @param task Set to the task removed.
+  *
+  * @return The priority of the task, or -1 if no tasks are queued.
+  */
+static int task_queue_pop(TaskQueueSlot &task)
+{
+    target_disable_irq();
+
+    int level = task_queue_highest_level();
+
+    if (level >= 0)
+    {
+        TaskQueueRing &ring = taskQueue[level];
+
+        task = ring.slots[ring.head];
+        ring.head = (ring.head + 1) % CODAL_TASK_QUEUE_SIZE;
+
+        if (--ring.length == 0)
+            taskQueueMap &= ~(1UL << level);
+    }
+
+    target_enable_irq();
+
+    return level;
+}
+
+/**
+  * The body of the worker fiber. Runs queued tasks to completion, most urgent first.
+  */
+static void task_queue_worker()
+{
+    TaskQueueSlot task;
+
+    while (1)
+    {
+        // Sleep until there is something to do.
+        taskCount.wait();
+
+        int level = task_queue_pop(task);
+
+        if (level < 0)
+            continue;
+
+        // Run the task at its own priority. If it blocks, the fiber forked to complete it inherits this.
+        fiber_set_priority(currentFiber, level);
+
+        invoke(task.fn, task.arg);
+
+        // Run on at the priority of the most urgent task remaining.
+        level = task_queue_highest_level();
+        fiber_set_priority(currentFiber, level < 0 ? DEVICE_FIBER_PRIORITY_LOW : level);
+    }
+}
+
+int codal::task_queue_init()
+{
+    if (taskWorker)
+        return DEVICE_OK;
+
+    if (!fiber_scheduler_running())
+        return DEVICE_NOT_SUPPORTED;
+
+    taskWorker = create_fiber(task_queue_worker);
+
+    return taskWorker ? DEVICE_OK : DEVICE_NO_RESOURCES;
+}
+
+REAL_TIME_FUNC
+int codal::schedule_task(void (*fn)(void *), void *arg, int priority)
+{
+    if (fn == NULL || priority < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Start the worker on first use. Fibers cannot be created from interrupt context.
+    if (taskWorker == NULL && (target_in_irq() || task_queue_init() != DEVICE_OK))
+        return DEVICE_NOT_SUPPORTED;
+
+    if (priority >= CODAL_FIBER_PRIORITY_LEVELS)
+        priority = CODAL_FIBER_PRIORITY_LEVELS - 1;
+
+    target_disable_irq();
+
+    TaskQueueRing &ring = taskQueue[priority];
+
+    if (ring.length == CODAL_TASK_QUEUE_SIZE)
+    {
+        target_enable_irq();
+        return DEVICE_NO_RESOURCES;
+    }
+
+    TaskQueueSlot &slot = ring.slots[(ring.head + ring.length) % CODAL_TASK_QUEUE_SIZE];
+    slot.fn = fn;
+    slot.arg = arg;
+    ring.length++;
+
+    taskQueueMap |= 1UL << priority;
+
+    // Ensure the worker gets to this task as soon as its priority demands.
+    if (taskWorker->priority < priority)
+        fiber_set_priority(taskWorker, priority);
+
+    // Wake the worker, if it is waiting.
+    taskCount.notify();
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+int codal::task_queue_length()
+{
+    int length = 0;
+
+    for (int i = 0; i < CODAL_FIBER_PRIORITY_LEVELS; i++)
+        length += taskQueue[i].length;
+
+    return length;
+}
+
+#else
+
+int codal::task_queue_init()
+{
+    return DEVICE_NOT_SUPPORTED;
+}
+
+int codal::schedule_task(void (*fn)(void *), void *arg, int priority)
+{
+    return DEVICE_NOT_SUPPORTED;
+}
+
+int codal::task_queue_length()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * A compact binary trace of events passing through the MessageBus, and of scheduler context switches.
+  *
+  * Each entry records the time, the event, what happened to it and the fiber it happened on, so that
+  * the latency of an event can be followed from the point it is raised to the point its handlers complete.
+  */
+#include "CodalConfig.h"
+#include "CodalTrace.h"
+#include "CodalFiber.h"
+#include "Timer.h"
+#include "codal_target_hal.h"
+
+#if CODAL_TRACE_BUFFER_SIZE > 0
+
+using namespace codal;
+
+struct CodalTraceStore codalTraceStore = { CODAL_TRACE_MAGIC, CODAL_TRACE_BUFFER_SIZE, sizeof(CodalTraceEntry), 0 };
+
+REAL_TIME_FUNC
+void codal_trace(uint8_t phase, uint16_t source, uint16_t value, uint16_t arg)
+{
+    uint8_t fiber = CODAL_TRACE_FIBER_NONE;
+
+    if (target_in_irq())
+        fiber = CODAL_TRACE_FIBER_IRQ;
+    else if (fiber_scheduler_running())
+        fiber = currentFiber->trace_id;
+
+    // Take the timestamp with interrupts disabled, so that entries are held in time order.
+    target_disable_irq();
+
+    CodalTraceEntry &e = codalTraceStore.entries[codalTraceStore.ptr % CODAL_TRACE_BUFFER_SIZE];
+    codalTraceStore.ptr++;
+
+    e.timestamp = (uint32_t)system_timer_current_time_us();
+    e.source = source;
+    e.value = value;
+    e.phase = phase;
+    e.fiber = fiber;
+    e.arg = arg;
+
+    target_enable_irq();
+}
+
+void codal_trace_reset()
+{
+    target_disable_irq();
+    codalTraceStore.ptr = 0;
+    target_enable_irq();
+}
+
+#endif
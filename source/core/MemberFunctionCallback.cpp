@@ -35,9 +35,17 @@ DEALINGS IN THE SOFTWARE.
 
 #include "CodalConfig.h"
 #include "MemberFunctionCallback.h"
+#include "CodalSlab.h"
 
 using namespace codal;
 
+#if CODAL_CALLBACK_SLAB_SIZE > 0
+static uint64_t callbackSlabStorage[CODAL_SLAB_STORAGE(sizeof(MemberFunctionCallback), CODAL_CALLBACK_SLAB_SIZE)];
+static CodalSlab callbackSlab = { callbackSlabStorage, CODAL_SLAB_SLOT_SIZE(sizeof(MemberFunctionCallback)), CODAL_CALLBACK_SLAB_SIZE };
+#else
+static CodalSlab callbackSlab = { NULL, 0, 0 };
+#endif
+
 /**
   * Calls the method reference held by this MemberFunctionCallback.
   *
@@ -57,3 +65,19 @@ bool MemberFunctionCallback::operator==(const MemberFunctionCallback &mfc)
 {
     return (object == mfc.object && (memcmp(method,mfc.method,sizeof(method))==0));
 }
+
+/**
+  * Allocates MemberFunctionCallbacks from a fixed size pool (CODAL_CALLBACK_SLAB_SIZE), falling back to the heap.
+  */
+void *MemberFunctionCallback::operator new(size_t size)
+{
+    return callbackSlab.allocate(size);
+}
+
+/**
+  * Releases a MemberFunctionCallback allocated by operator new.
+  */
+void MemberFunctionCallback::operator delete(void *p)
+{
+    callbackSlab.release(p);
+}
@@ -46,6 +46,21 @@ __attribute__((weak)) void target_deepsleep()
     target_wait_for_event();
 }
 
+__attribute__((weak)) int target_in_irq()
+{
+#if defined(__arm__) && defined(__ARM_ARCH_PROFILE) && (__ARM_ARCH_PROFILE == 'M')
+    // On Cortex-M, IPSR holds the number of the exception being handled, or zero in thread mode.
+    uint32_t ipsr;
+    __asm volatile ("mrs %0, ipsr" : "=r" (ipsr));
+
+    return ipsr != 0;
+#else
+    // Elsewhere, the target must provide its own implementation to detect interrupt context.
+    // Until it does, assume we may be, so that callers never block.
+    return 1;
+#endif
+}
+
 // Preprocessor Directive to ignore redecleration when using clang
 #ifndef __clang__
 	/**
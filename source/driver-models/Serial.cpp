@@ -1,6 +1,7 @@
 #include "Serial.h"
 #include "NotifyEvents.h"
 #include "CodalDmesg.h"
+#include "CodalHeapAllocator.h"
 
 using namespace codal;
 
@@ -169,7 +170,7 @@ int Serial::initialiseRx()
 
     status &= ~CODAL_SERIAL_STATUS_RX_BUFF_INIT;
 
-    if((this->rxBuff = (uint8_t *)malloc(rxBuffSize)) == NULL)
+    if((this->rxBuff = (uint8_t *)device_malloc_hint(rxBuffSize, DEVICE_HEAP_DMA)) == NULL)
         return DEVICE_NO_RESOURCES;
 
     this->rxBuffHead = 0;
@@ -197,7 +198,7 @@ int Serial::initialiseTx()
 
     status &= ~CODAL_SERIAL_STATUS_TX_BUFF_INIT;
 
-    if((this->txBuff = (uint8_t *)malloc(txBuffSize)) == NULL)
+    if((this->txBuff = (uint8_t *)device_malloc_hint(txBuffSize, DEVICE_HEAP_DMA)) == NULL)
         return DEVICE_NO_RESOURCES;
 
     this->txBuffHead = 0;
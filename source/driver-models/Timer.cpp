@@ -729,7 +729,9 @@ int codal::system_timer_calibrate_cycles()
     uint32_t start = system_timer->getTimeUs();
     system_timer_wait_cycles(10000);
     uint32_t end = system_timer->getTimeUs();
-    cycleScale = (10000) / (end - start - 5);
+
+    // If the loop completes too quickly to measure, fall back to timer based waits.
+    cycleScale = (end - start > 5) ? (10000) / (end - start - 5) : 0;
 
     return DEVICE_OK;
 }
@@ -743,6 +745,7 @@ int codal::system_timer_calibrate_cycles()
 FORCE_RAM_FUNC
 void codal::system_timer_wait_cycles(uint32_t cycles)
 {
+#if defined(__arm__) || defined(__thumb__)
     __asm__ __volatile__(
         ".syntax unified\n"
         "1:              \n"
@@ -752,6 +755,11 @@ void codal::system_timer_wait_cycles(uint32_t cycles)
         :                    // no input
         :                    // no clobber
     );
+#else
+    volatile uint32_t n = cycles;
+    while (n)
+        n--;
+#endif
 }
 
 /**
@@ -48,16 +48,89 @@ DEALINGS IN THE SOFTWARE.
   */
 #include "CodalConfig.h"
 #include "MessageBus.h"
+#include "EventRing.h"
 #include "CodalFiber.h"
 #include "CodalDmesg.h"
 #include "ErrorNo.h"
 #include "NotifyEvents.h"
+#include "CodalTrace.h"
 #include "codal_target_hal.h"
 
 using namespace codal;
 
 static uint16_t userNotifyId = DEVICE_NOTIFY_USER_EVENT_BASE;
 
+// The number of events merged into the event given to the standard handler that is currently running.
+static uint8_t handlerMerged = 0;
+
+#define LISTENER_WILDCARD       MESSAGE_BUS_LISTENER_BUCKETS
+
+/**
+  * Determines the bucket of a listener table used for listeners to the given source id.
+  */
+static inline int listener_bucket(uint16_t id)
+{
+#if MESSAGE_BUS_LISTENER_BUCKETS > 0
+    if (id != DEVICE_ID_ANY)
+        return id % MESSAGE_BUS_LISTENER_BUCKETS;
+#endif
+
+    return LISTENER_WILDCARD;
+}
+
+/**
+  * Determines if the given listener matches the given event.
+  */
+static inline bool listener_matches(Listener *l, Event &evt)
+{
+    return (l->id == evt.source || l->id == DEVICE_ID_ANY) && (l->value == evt.value || l->value == DEVICE_EVT_ANY);
+}
+
+/**
+  * Determines if any listener in the given table would be interested in the given event.
+  * Each chain is held in increasing order of id, so we can stop as soon as we pass the event's source.
+  */
+static bool listeners_match(Listener **table, Event &evt)
+{
+    int bucket = listener_bucket(evt.source);
+
+    for (Listener *l = table[bucket]; l != NULL && l->id <= evt.source; l = l->next)
+        if (listener_matches(l, evt) && !(l->flags & MESSAGE_BUS_LISTENER_DELETING))
+            return true;
+
+    if (bucket != LISTENER_WILDCARD)
+        for (Listener *l = table[LISTENER_WILDCARD]; l != NULL; l = l->next)
+            if (listener_matches(l, evt) && !(l->flags & MESSAGE_BUS_LISTENER_DELETING))
+                return true;
+
+    return false;
+}
+
+/**
+  * Adds the given listener to the given chain.
+  * The chain is held stictly in increasing order of ID (first level), then value code (second level).
+  */
+static void listener_insert(Listener **chain, Listener *newListener)
+{
+    Listener *l = *chain;
+    Listener *p = NULL;
+
+    // Find the correct point in the chain for this event.
+    // Adding a listener is a rare occurance, so we just walk the list...
+    while (l != NULL && (l->id < newListener->id || (l->id == newListener->id && l->value < newListener->value)))
+    {
+        p = l;
+        l = l->next;
+    }
+
+    newListener->next = l;
+
+    if (p == NULL)
+        *chain = newListener;
+    else
+        p->next = newListener;
+}
+
 /**
   * Default constructor.
   *
@@ -65,14 +138,47 @@ static uint16_t userNotifyId = DEVICE_NOTIFY_USER_EVENT_BASE;
   * default EventModel if defaultEventBus is NULL.
   */
 MessageBus::MessageBus()
+    : queueSpace(0)
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+    , handlerJobsWaiting(0, FiberLockMode::SEMAPHORE)
+#endif
 {
-    this->listeners = NULL;
-    this->evt_queue_head = NULL;
-    this->evt_queue_tail = NULL;
+    for (int i = 0; i <= MESSAGE_BUS_LISTENER_BUCKETS; i++)
+    {
+        this->listeners[i] = NULL;
+        this->urgentListeners[i] = NULL;
+    }
+
+    this->staticTableCount = 0;
+    this->queueHead = 0;
     this->queueLength = 0;
+    this->queueDequeued = 0;
+    this->queueSize = MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH;
+    this->evt_queue = evt_queue_storage;
+    this->evt_queue_merged = evt_queue_merged_storage;
+    this->overflowPolicy = MESSAGE_BUS_OVERFLOW_POLICY;
+    this->merged = 0;
+    this->batchPending = 0;
+
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+    this->handlerJobHead = 0;
+    this->handlerJobCount = 0;
+    this->handlerWorkers = 0;
+#endif
+
+    memset(&stats, 0, sizeof(stats));
+
+#if MESSAGE_BUS_COALESCE_SOURCES > 0
+    for (int i = 0; i < MESSAGE_BUS_COALESCE_SOURCES; i++)
+        this->coalesceIds[i] = DEVICE_ID_ANY;
+#endif
+
+    static constexpr StaticListener messageBusListeners[] = {
+        { DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE, MessageBus::idleCallback },
+    };
 
     // ANY listeners for scheduler events MUST be immediate, or else they will not be registered.
-    listen(DEVICE_ID_SCHEDULER, DEVICE_SCHEDULER_EVT_IDLE, this, &MessageBus::idle, MESSAGE_BUS_LISTENER_IMMEDIATE);
+    addStaticListeners(messageBusListeners, sizeof(messageBusListeners) / sizeof(StaticListener), this);
 
     if(EventModel::defaultEventBus == NULL)
         EventModel::defaultEventBus = this;
@@ -89,6 +195,34 @@ void async_callback(void *param)
 {
     Listener *listener = (Listener *)param;
 
+    // Batch listeners are given every event collected in their queue, until it is empty.
+    if (listener->flags & MESSAGE_BUS_LISTENER_BATCH)
+    {
+        // The fiber already running this handler will deliver any events collected meanwhile.
+        if (listener->flags & MESSAGE_BUS_LISTENER_BUSY)
+            return;
+
+        listener->flags |= MESSAGE_BUS_LISTENER_BUSY;
+
+        while (listener->evt_queue_length > 0)
+        {
+            // The queue is a ring, so deliver the events up to its end, and any that have wrapped around
+            // to its start as a further batch.
+            int head = listener->evt_queue_head;
+            int count = min(listener->evt_queue_length, MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH - head);
+
+            listener->cb_batch(listener->evt_queue + head, count, listener->cb_arg);
+
+            // Events may have been collected while the handler ran. These were added after the batch
+            // we delivered, so are delivered on the next pass.
+            listener->evt_queue_head = (head + count) % MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH;
+            listener->evt_queue_length -= count;
+        }
+
+        listener->flags &= ~MESSAGE_BUS_LISTENER_BUSY;
+        return;
+    }
+
     // OK, now we need to decide how to behave depending on our configuration.
     // If this a fiber f already active within this listener then check our
     // configuration to determine the correct course of action.
@@ -103,7 +237,7 @@ void async_callback(void *param)
         // Queue this event up for later, if that's how we've been configured.
         if (listener->flags & MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY)
         {
-            listener->queue(listener->evt);
+            listener->queue(listener->evt, listener->evt_merged);
             return;
         }
     }
@@ -116,6 +250,16 @@ void async_callback(void *param)
 
     while (1)
     {
+#if CODAL_TRACE_BUFFER_SIZE > 0
+        // listener->evt may be replaced by a later event while the handler runs.
+        Event traced = listener->evt;
+        CODAL_TRACE(CODAL_TRACE_HANDLER, traced.source, traced.value, 0);
+#endif
+
+        // Urgent handlers may run in interrupt context, so must not disturb the count of a standard handler.
+        if (!(listener->flags & MESSAGE_BUS_LISTENER_URGENT))
+            handlerMerged = listener->evt_merged;
+
         // Firstly, check for a method callback into an object.
         if (listener->flags & MESSAGE_BUS_LISTENER_METHOD)
             listener->cb_method->fire(listener->evt);
@@ -128,16 +272,11 @@ void async_callback(void *param)
         else
             listener->cb(listener->evt);
 
+        CODAL_TRACE(CODAL_TRACE_HANDLED, traced.source, traced.value, 0);
 
         // If there are more events to process, dequeue the next one and process it.
-        if ((listener->flags & MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY) && listener->evt_queue)
+        if ((listener->flags & MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY) && listener->dequeue(listener->evt, listener->evt_merged) == DEVICE_OK)
         {
-            EventQueueItem *item = listener->evt_queue;
-
-            listener->evt = item->evt;
-            listener->evt_queue = listener->evt_queue->next;
-            delete item;
-
             // We spin the scheduler here, to preven any particular event handler from continuously holding onto resources.
             schedule();
         }
@@ -159,8 +298,11 @@ REAL_TIME_FUNC
 void MessageBus::queueEvent(Event &evt)
 {
     int processingComplete;
+    int position;
 
-    EventQueueItem *prev = evt_queue_tail;
+    // Record the tail of the queue at the point where we entered queueEvent().
+    int length = queueLength;
+    uint16_t dequeued = queueDequeued;
 
     // Now process all handler regsitered as URGENT.
     // These pre-empt the queue, and are useful for fast, high priority services.
@@ -171,71 +313,311 @@ void MessageBus::queueEvent(Event &evt)
     if (processingComplete)
         return;
 
-    // If we need to queue, but there is no space, then there's nothg we can do.
-    if (queueLength >= MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH)
+    target_disable_irq();
+
+#if MESSAGE_BUS_COALESCE_SOURCES > 0
+    // If this source is coalescing, merge this event into an identical one that is still waiting to be processed.
+    for (int i = 0; i < MESSAGE_BUS_COALESCE_SOURCES; i++)
+    {
+        if (coalesceIds[i] == evt.source)
+        {
+            for (int j = 0; j < queueLength; j++)
+            {
+                int slot = (queueHead + j) % queueSize;
+
+                if (evt_queue[slot].source == evt.source && evt_queue[slot].value == evt.value)
+                {
+                    evt_queue[slot].timestamp = evt.timestamp;
+
+                    if (evt_queue_merged[slot] < 255)
+                        evt_queue_merged[slot]++;
+
+                    stats.merged++;
+
+                    CODAL_TRACE(CODAL_TRACE_MERGED, evt.source, evt.value, 0);
+
+                    target_enable_irq();
+                    return;
+                }
+            }
+
+            break;
+        }
+    }
+#endif
+
+    // If we need to queue, but there is no space, apply our overflow policy.
+    while (queueLength >= queueSize)
     {
+        if (overflowPolicy == MESSAGE_BUS_OVERFLOW_DROP_OLDEST)
+        {
+            // Discard the event at the head of the queue. This is accounted for as a dequeue, so that we still
+            // maintain the ordering of events below.
+            recordDrop(evt_queue[queueHead].source);
+            CODAL_TRACE(CODAL_TRACE_DROPPED, evt_queue[queueHead].source, evt_queue[queueHead].value, 1);
+
+            queueHead = (queueHead + 1) % queueSize;
+            queueLength--;
+            queueDequeued++;
+            break;
+        }
+
+        if (overflowPolicy == MESSAGE_BUS_OVERFLOW_BLOCK && fiber_can_block())
+        {
+            bool draining = true;
+
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+            // idle() leaves events queued while the handler queue is full, so a worker fiber could wait forever.
+            draining = handlerJobCount < MESSAGE_BUS_HANDLER_QUEUE_SIZE;
+#endif
+
+            if (draining)
+            {
+                // Hold up the sender until the idle fiber takes an event from the queue, then try again.
+                // No handlers are run on the sender, so a handler sending from within idle() (through
+                // fork on block) cannot re-enter the processing of the queue.
+                target_enable_irq();
+                queueSpace.wait();
+                target_disable_irq();
+                continue;
+            }
+        }
+
+        if (overflowPolicy == MESSAGE_BUS_OVERFLOW_GROW && growQueue() == DEVICE_OK)
+            continue;
+
+        // Otherwise, there's nothing we can do.
         // Note that this can lead to strange lockups, where we await an event that never arrives.
-        //DMESG("evt %d/%d: overflow!", evt.source, evt.value);
+        recordDrop(evt.source);
+        CODAL_TRACE(CODAL_TRACE_DROPPED, evt.source, evt.value, 0);
+        target_enable_irq();
         return;
     }
 
     // Otherwise, we need to queue this event for later processing...
     // We queue this event at the tail of the queue at the point where we entered queueEvent()
     // This is important as the processing above *may* have generated further events, and
-    // we want to maintain ordering of events.
-    EventQueueItem *item = new EventQueueItem(evt);
+    // we want to maintain ordering of events. Account for any events that have been dequeued since.
+    position = length - (uint16_t)(queueDequeued - dequeued);
 
-    // The queue was empty when we entered this function, so queue our event at the start of the queue.
-    target_disable_irq();
+    if (position < 0)
+        position = 0;
 
-    if (prev == NULL)
-    {
-        item->next = evt_queue_head;
-        evt_queue_head = item;
-    }
-    else
+    // Move any later events up one place in the ring, to make space for our event.
+    for (int i = queueLength; i > position; i--)
     {
-        item->next = prev->next;
-        prev->next = item;
-    }
+        int to = (queueHead + i) % queueSize;
+        int from = (queueHead + i - 1) % queueSize;
 
-    if (item->next == NULL)
-        evt_queue_tail = item;
+        evt_queue[to] = evt_queue[from];
+        evt_queue_merged[to] = evt_queue_merged[from];
+    }
 
+    evt_queue[(queueHead + position) % queueSize] = evt;
+    evt_queue_merged[(queueHead + position) % queueSize] = 0;
     queueLength++;
 
+    stats.enqueued++;
+
+    CODAL_TRACE(CODAL_TRACE_QUEUED, evt.source, evt.value, 0);
+
+    if (queueLength > stats.maxDepth)
+        stats.maxDepth = queueLength;
+
     target_enable_irq();
 }
 
 /**
   * Extract the next event from the front of the event queue (if present).
   *
-  * @return a pointer to the EventQueueItem that is at the head of the list.
+  * @param evt Updated with the event at the front of the queue.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_DATA if the queue is empty.
   */
 REAL_TIME_FUNC
-EventQueueItem* MessageBus::dequeueEvent()
+int MessageBus::dequeueEvent(Event &evt)
 {
-    EventQueueItem *item = NULL;
+    int result = DEVICE_NO_DATA;
 
     target_disable_irq();
 
-    if (evt_queue_head != NULL)
+    if (queueLength > 0)
     {
-        item = evt_queue_head;
-        evt_queue_head = item->next;
-
-        if (evt_queue_head == NULL)
-            evt_queue_tail = NULL;
+        evt = evt_queue[queueHead];
+        merged = evt_queue_merged[queueHead];
+        queueHead = (queueHead + 1) % queueSize;
 
         queueLength--;
+        queueDequeued++;
+
+        // Let the longest waiting sender queue its event, if any are blocked on a full queue.
+        if (queueSpace.getWaitCount())
+            queueSpace.notify();
+
+        result = DEVICE_OK;
     }
 
     target_enable_irq();
 
+    return result;
+}
+
+/**
+  * Doubles the capacity of the event queue, up to MESSAGE_BUS_QUEUE_GROW_LIMIT events.
+  * Must be called with interrupts disabled, and returns with interrupts disabled.
+  *
+  * @return DEVICE_OK if the queue has grown, or DEVICE_NO_RESOURCES if it cannot.
+  */
+int MessageBus::growQueue()
+{
+    uint16_t size = queueSize;
+    int newSize = min(size * 2, MESSAGE_BUS_QUEUE_GROW_LIMIT);
+
+    if (newSize <= size)
+        return DEVICE_NO_RESOURCES;
+
+    // Allocate the new queue without holding off interrupts for longer than we must.
+    target_enable_irq();
+
+    Event *q = new Event[newSize];
+    uint8_t *m = (uint8_t *)malloc(newSize);
+
+    target_disable_irq();
+
+    if (q == NULL || m == NULL || queueSize != size)
+    {
+        // Either we're out of memory, or the queue was grown while we were allocating.
+        delete[] q;
+        free(m);
+
+        return queueSize != size ? DEVICE_OK : DEVICE_NO_RESOURCES;
+    }
+
+    for (int i = 0; i < queueLength; i++)
+    {
+        q[i] = evt_queue[(queueHead + i) % queueSize];
+        m[i] = evt_queue_merged[(queueHead + i) % queueSize];
+    }
+
+    if (evt_queue != evt_queue_storage)
+    {
+        delete[] evt_queue;
+        free(evt_queue_merged);
+    }
+
+    evt_queue = q;
+    evt_queue_merged = m;
+    queueHead = 0;
+    queueSize = newSize;
 
-    return item;
+    return DEVICE_OK;
+}
+
+/**
+  * Records that an event from the given source has been dropped.
+  *
+  * @param id The source of the dropped event.
+  */
+void MessageBus::recordDrop(uint16_t id)
+{
+    stats.dropped++;
+
+    for (int i = 0; i < MESSAGE_BUS_STATS_DROP_SOURCES; i++)
+    {
+        if (stats.sources[i].id == id || stats.sources[i].id == DEVICE_ID_ANY)
+        {
+            stats.sources[i].id = id;
+            stats.sources[i].dropped++;
+            break;
+        }
+    }
 }
 
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+/**
+  * Queues a call to the given listener, to be run by a worker fiber.
+  *
+  * @param listener The listener to call.
+  *
+  * @param evt The event to deliver.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the handler queue is full.
+  */
+int MessageBus::queueHandler(Listener *listener, Event &evt)
+{
+    if (handlerJobCount >= MESSAGE_BUS_HANDLER_QUEUE_SIZE)
+        return DEVICE_NO_RESOURCES;
+
+    // Bring up another worker if all those we have may already be busy.
+    if (handlerWorkers < MESSAGE_BUS_HANDLER_FIBERS && handlerJobCount >= handlerJobsWaiting.getWaitCount())
+    {
+        if (create_fiber(handlerWorker, this) != NULL)
+            handlerWorkers++;
+    }
+
+    target_disable_irq();
+    MessageBusHandlerJob &job = handlerJobs[(handlerJobHead + handlerJobCount) % MESSAGE_BUS_HANDLER_QUEUE_SIZE];
+    job.listener = listener;
+    job.evt = evt;
+    job.merged = listener->evt_merged;
+    handlerJobCount++;
+    target_enable_irq();
+
+    handlerJobsWaiting.notify();
+
+    return DEVICE_OK;
+}
+
+/**
+  * Determines if a call to the given listener is waiting for a worker fiber.
+  */
+bool MessageBus::handlerQueued(Listener *listener)
+{
+    for (int i = 0; i < handlerJobCount; i++)
+        if (handlerJobs[(handlerJobHead + i) % MESSAGE_BUS_HANDLER_QUEUE_SIZE].listener == listener)
+            return true;
+
+    return false;
+}
+
+/**
+  * The body of each worker fiber: runs queued handler calls, in the order in which they were queued.
+  *
+  * @param bus The MessageBus that owns this worker.
+  */
+void MessageBus::handlerWorker(void *bus)
+{
+    MessageBus *b = (MessageBus *)bus;
+
+    while (1)
+    {
+        b->handlerJobsWaiting.wait();
+
+        target_disable_irq();
+
+        if (b->handlerJobCount == 0)
+        {
+            target_enable_irq();
+            continue;
+        }
+
+        MessageBusHandlerJob job = b->handlerJobs[b->handlerJobHead];
+        b->handlerJobHead = (b->handlerJobHead + 1) % MESSAGE_BUS_HANDLER_QUEUE_SIZE;
+        b->handlerJobCount--;
+
+        target_enable_irq();
+
+        // The listener may have been removed since this call was queued.
+        if (job.listener->flags & MESSAGE_BUS_LISTENER_DELETING)
+            continue;
+
+        job.listener->evt = job.evt;
+        job.listener->evt_merged = job.merged;
+        async_callback(job.listener);
+    }
+}
+#endif
+
 /**
   * Cleanup any Listeners marked for deletion from the list.
   *
@@ -244,38 +626,97 @@ EventQueueItem* MessageBus::dequeueEvent()
 int MessageBus::deleteMarkedListeners()
 {
     Listener *l, *p;
+    Listener **tables[2] = { listeners, urgentListeners };
+    Listener **chain;
     int removed = 0;
 
-    l = listeners;
-    p = NULL;
-
-    // Walk this list of event handlers. Delete any that match the given listener.
-    while (l != NULL)
+    for (int i = 0; i < 2 * (MESSAGE_BUS_LISTENER_BUCKETS + 1); i++)
     {
-        if ((l->flags & MESSAGE_BUS_LISTENER_DELETING) && !(l->flags & MESSAGE_BUS_LISTENER_BUSY))
+        chain = &tables[i & 1][i >> 1];
+        l = *chain;
+        p = NULL;
+
+        // Walk this list of event handlers. Delete any that match the given listener.
+        while (l != NULL)
         {
-            if (p == NULL)
-                listeners = l->next;
-            else
-                p->next = l->next;
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+            if ((l->flags & MESSAGE_BUS_LISTENER_DELETING) && !(l->flags & MESSAGE_BUS_LISTENER_BUSY) && !handlerQueued(l))
+#else
+            if ((l->flags & MESSAGE_BUS_LISTENER_DELETING) && !(l->flags & MESSAGE_BUS_LISTENER_BUSY))
+#endif
+            {
+                if (p == NULL)
+                    *chain = l->next;
+                else
+                    p->next = l->next;
 
-            // delete the listener.
-            Listener *t = l;
-            l = l->next;
+                if (l->flags & MESSAGE_BUS_LISTENER_BATCH_PENDING)
+                    batchPending--;
 
-            delete t;
-            removed++;
+                // delete the listener.
+                Listener *t = l;
+                l = l->next;
 
-            continue;
-        }
+                delete t;
+                removed++;
 
-        p = l;
-        l = l->next;
+                continue;
+            }
+
+            p = l;
+            l = l->next;
+        }
     }
 
     return removed;
 }
 
+/**
+  * Registers a table of listeners fixed at compile time, each treated as MESSAGE_BUS_LISTENER_IMMEDIATE.
+  *
+  * Static listeners are checked for every event before any dynamically registered listener, and need
+  * no heap allocation. Registering the same table with the same context more than once has no effect.
+  *
+  * @param table The table of listeners, which must remain valid for the lifetime of the MessageBus.
+  *
+  * @param count The number of entries in the table.
+  *
+  * @param context The context given to each handler in the table.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if table is NULL, or DEVICE_NO_RESOURCES if
+  *         MESSAGE_BUS_STATIC_TABLES tables are already registered.
+  */
+int MessageBus::addStaticListeners(const StaticListener *table, int count, void *context)
+{
+    if (table == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (int t = 0; t < staticTableCount; t++)
+        if (staticTables[t].table == table && staticTables[t].context == context)
+            return DEVICE_OK;
+
+    if (staticTableCount >= MESSAGE_BUS_STATIC_TABLES)
+        return DEVICE_NO_RESOURCES;
+
+    MessageBusStaticTable &s = staticTables[staticTableCount];
+    s.table = table;
+    s.count = count;
+    s.context = context;
+
+    // Only publish the table once it is complete, as events may be processed from interrupt context.
+    staticTableCount++;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Static listener for scheduler idle events, calling idle() on the given MessageBus.
+  */
+void MessageBus::idleCallback(Event evt, void *bus)
+{
+    ((MessageBus *)bus)->idle(evt);
+}
+
 /**
   * Periodic callback from Device.
   *
@@ -287,26 +728,34 @@ void MessageBus::idle(Event)
     // Clear out any listeners marked for deletion
     this->deleteMarkedListeners();
 
-    EventQueueItem *item = this->dequeueEvent();
+    // Raise any events pushed by interrupt handlers since we last ran, now that we're in thread context.
+    EventRing::drain();
+
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+    // Leave events in our queue while the handler queue is full, until the worker fibers catch up.
+    if (handlerJobCount >= MESSAGE_BUS_HANDLER_QUEUE_SIZE)
+        return;
+#endif
+
+    Event evt;
 
     // Whilst there are events to process and we have no useful other work to do, pull them off the queue and process them.
-    while (item)
+    while (this->dequeueEvent(evt) == DEVICE_OK)
     {
         // send the event to all standard event listeners.
-        this->process(item->evt);
-
-        // Free the queue item.
-        delete item;
+        this->process(evt);
+        merged = 0;
 
         // If we have created some useful work to do, we stop processing.
         // This helps to minimise the number of blocked fibers we create at any point in time, therefore
         // also reducing the RAM footprint.
         if(!scheduler_runqueue_empty())
             break;
-
-        // Pull the next event to process, if there is one.
-        item = this->dequeueEvent();
     }
+
+    // Once our queue is drained, hand each batch listener the events it has collected.
+    if (batchPending && queueLength == 0)
+        flushBatches();
 }
 
 /**
@@ -356,49 +805,157 @@ int MessageBus::send(Event evt)
 REAL_TIME_FUNC
 int MessageBus::process(Event &evt, bool urgent)
 {
-    Listener *l;
     int complete = 1;
-    bool listenerUrgent;
 
-    l = listeners;
+    if (urgent)
+    {
+        // Listeners fixed at compile time are always immediate, and take precedence.
+        for (int t = 0; t < staticTableCount; t++)
+        {
+            const MessageBusStaticTable &s = staticTables[t];
+
+            for (int i = 0; i < s.count; i++)
+                if ((s.table[i].id == evt.source || s.table[i].id == DEVICE_ID_ANY) && (s.table[i].value == evt.value || s.table[i].value == DEVICE_EVT_ANY))
+                    s.table[i].cb(evt, s.context);
+        }
+
+        dispatch(urgentListeners, evt);
+
+        // If we're not yet running under the fiber scheduler, every listener is treated as urgent.
+        // Otherwise, determine if any standard listeners still need to see this event.
+        if (!fiber_scheduler_running())
+            dispatch(listeners, evt);
+        else if (listeners_match(listeners, evt))
+            complete = 0;
+    }
+    else if (fiber_scheduler_running())
+    {
+        CODAL_TRACE(CODAL_TRACE_DISPATCHED, evt.source, evt.value, 0);
+        dispatch(listeners, evt, merged);
+    }
+
+    return complete;
+}
+
+/**
+  * Delivers the given event to each matching listener held in the given listener table.
+  *
+  * @param table The listener table to walk.
+  *
+  * @param evt The event to deliver.
+  *
+  * @param mergeCount The number of events merged into evt.
+  */
+REAL_TIME_FUNC
+void MessageBus::dispatch(Listener **table, Event &evt, uint8_t mergeCount)
+{
+    Listener *l;
+    int bucket = listener_bucket(evt.source);
 
-    while (l != NULL)
+    // Listeners to DEVICE_ID_ANY sort before any other source, so visit them first to maintain the order of delivery.
+    for (int i = 0; i < 2; i++)
     {
-        if((l->id == evt.source || l->id == DEVICE_ID_ANY) && (l->value == evt.value || l->value == DEVICE_EVT_ANY))
+        l = table[i == 0 ? LISTENER_WILDCARD : bucket];
+
+        // Each chain is held in increasing order of id, so we can stop as soon as we pass the event's source.
+        while (l != NULL && l->id <= evt.source)
         {
-            // If we're running under the fiber scheduler, then derive the THREADING_MODE for the callback based on the
-            // metadata in the listener itself.
-            if (fiber_scheduler_running())
-                listenerUrgent = (l->flags & MESSAGE_BUS_LISTENER_IMMEDIATE) == MESSAGE_BUS_LISTENER_IMMEDIATE;
-            else
-                listenerUrgent = true;
-
-            // If we should process this event hander in this pass, then activate the listener.
-            if(listenerUrgent == urgent && !(l->flags & MESSAGE_BUS_LISTENER_DELETING))
+            if(listener_matches(l, evt) && !(l->flags & MESSAGE_BUS_LISTENER_DELETING))
             {
                 l->evt = evt;
+                l->evt_merged = mergeCount;
 
-                // OK, if this handler has regisitered itself as non-blocking, we just execute it directly...
-                // This is normally only done for trusted system components.
-                // Otherwise, we invoke it in a 'fork on block' context, that will automatically create a fiber
-                // should the event handler attempt a blocking operation, but doesn't have the overhead
-                // of creating a fiber needlessly. (cool huh?)
-                if (l->flags & MESSAGE_BUS_LISTENER_NONBLOCKING || !fiber_scheduler_running())
-                    async_callback(l);
+                if (l->flags & MESSAGE_BUS_LISTENER_BATCH)
+                    batchEvent(l, evt);
                 else
-                    invoke(async_callback, l);
+                    deliver(l, evt);
             }
-            else
-                complete = 0;
+
+            l = l->next;
         }
 
-        l = l->next;
+        if (bucket == LISTENER_WILDCARD)
+            break;
     }
+}
 
-    //Serial.println("EXIT");
-    //while (!(UCSR0A & _BV(TXC0)));
+/**
+  * Calls the given listener, directly or on another fiber as its flags require.
+  *
+  * @param l The listener to call.
+  *
+  * @param evt The event to deliver.
+  */
+REAL_TIME_FUNC
+void MessageBus::deliver(Listener *l, Event &evt)
+{
+    // OK, if this handler has regisitered itself as non-blocking, we just execute it directly...
+    // This is normally only done for trusted system components.
+    // Otherwise, we invoke it in a 'fork on block' context, that will automatically create a fiber
+    // should the event handler attempt a blocking operation, but doesn't have the overhead
+    // of creating a fiber needlessly. (cool huh?)
+    if (l->flags & MESSAGE_BUS_LISTENER_NONBLOCKING || !fiber_scheduler_running())
+        async_callback(l);
+#if MESSAGE_BUS_HANDLER_FIBERS > 0
+    // Otherwise, if we have a pool of worker fibers, hand this call to one of them.
+    // Should the handler queue fill part way through an event, we fall back to fork on block for the rest.
+    else if (queueHandler(l, evt) != DEVICE_OK)
+        invoke(async_callback, l);
+#else
+    else
+        invoke(async_callback, l);
+#endif
+}
 
-    return complete;
+/**
+  * Adds the given event to the batch collected by the given MESSAGE_BUS_LISTENER_BATCH listener.
+  *
+  * @param l The listener.
+  *
+  * @param evt The event to add.
+  */
+void MessageBus::batchEvent(Listener *l, Event &evt)
+{
+    // A full batch is delivered straight away, to make space. Should the handler still be running
+    // from an earlier batch, the event is dropped, as for any other listener with a full queue.
+    if (l->evt_queue_length >= MESSAGE_BUS_LISTENER_MAX_QUEUE_DEPTH)
+        deliver(l, evt);
+
+    l->queue(evt, l->evt_merged);
+
+    // Without the scheduler, our queue is never drained by idle(), so deliver each event as it arrives.
+    if (!fiber_scheduler_running())
+    {
+        deliver(l, evt);
+        return;
+    }
+
+    if (!(l->flags & MESSAGE_BUS_LISTENER_BATCH_PENDING))
+    {
+        l->flags |= MESSAGE_BUS_LISTENER_BATCH_PENDING;
+        batchPending++;
+    }
+}
+
+/**
+  * Delivers the events collected by each batch listener.
+  */
+void MessageBus::flushBatches()
+{
+    for (int i = 0; i <= MESSAGE_BUS_LISTENER_BUCKETS && batchPending > 0; i++)
+    {
+        for (Listener *l = listeners[i]; l != NULL; l = l->next)
+        {
+            if (l->flags & MESSAGE_BUS_LISTENER_BATCH_PENDING)
+            {
+                l->flags &= ~MESSAGE_BUS_LISTENER_BATCH_PENDING;
+                batchPending--;
+
+                if (!(l->flags & MESSAGE_BUS_LISTENER_DELETING))
+                    deliver(l, l->evt);
+            }
+        }
+    }
 }
 
 /**
@@ -410,83 +967,44 @@ int MessageBus::process(Event &evt, bool urgent)
   */
 int MessageBus::add(Listener *newListener)
 {
-    Listener *l, *p;
+    Listener *l;
     int methodCallback;
 
     //handler can't be NULL!
     if (newListener == NULL)
         return DEVICE_INVALID_PARAMETER;
 
-    l = listeners;
-
     // Firstly, we treat a listener as an idempotent operation. Ensure we don't already have this handler
     // registered in a that will already capture these events. If we do, silently ignore.
-
-    // We always check the ID, VALUE and CB_METHOD fields.
-    // If we have a callback to a method, check the cb_method class. Otherwise, the cb function point is sufficient.
-    while (l != NULL)
+    // Any such listener must be held in the same bucket of either the urgent or the standard listener table.
+    for (int i = 0; i < 2; i++)
     {
-        methodCallback = (newListener->flags & MESSAGE_BUS_LISTENER_METHOD) && (l->flags & MESSAGE_BUS_LISTENER_METHOD);
+        l = (i == 0 ? listeners : urgentListeners)[listener_bucket(newListener->id)];
 
-        if (l->id == newListener->id && l->value == newListener->value && (methodCallback ? *l->cb_method == *newListener->cb_method : l->cb == newListener->cb) && newListener->cb_arg == l->cb_arg)
+        // We always check the ID, VALUE and CB_METHOD fields.
+        // If we have a callback to a method, check the cb_method class. Otherwise, the cb function point is sufficient.
+        while (l != NULL)
         {
-            // We have a perfect match for this event listener already registered.
-            // If it's marked for deletion, we simply resurrect the listener, and we're done.
-            // Either way, we return an error code, as the *new* listener should be released...
-            if(l->flags & MESSAGE_BUS_LISTENER_DELETING)
-                l->flags &= ~MESSAGE_BUS_LISTENER_DELETING;
-
-            return DEVICE_NOT_SUPPORTED;
-        }
-
-        l = l->next;
-    }
-
-    // We have a valid, new event handler. Add it to the list.
-    // if listeners is null - we can automatically add this listener to the list at the beginning...
-    if (listeners == NULL)
-    {
-        listeners = newListener;
-        Event(DEVICE_ID_MESSAGE_BUS_LISTENER, newListener->id);
+            methodCallback = (newListener->flags & MESSAGE_BUS_LISTENER_METHOD) && (l->flags & MESSAGE_BUS_LISTENER_METHOD);
 
-        return DEVICE_OK;
-    }
-
-    // We maintain an ordered list of listeners.
-    // The chain is held stictly in increasing order of ID (first level), then value code (second level).
-    // Find the correct point in the chain for this event.
-    // Adding a listener is a rare occurance, so we just walk the list...
-
-    p = listeners;
-    l = listeners;
-
-    while (l != NULL && l->id < newListener->id)
-    {
-        p = l;
-        l = l->next;
-    }
-
-    while (l != NULL && l->id == newListener->id && l->value < newListener->value)
-    {
-        p = l;
-        l = l->next;
-    }
+            if (l->id == newListener->id && l->value == newListener->value && (methodCallback ? *l->cb_method == *newListener->cb_method : l->cb == newListener->cb) && newListener->cb_arg == l->cb_arg)
+            {
+                // We have a perfect match for this event listener already registered.
+                // If it's marked for deletion, we simply resurrect the listener, and we're done.
+                // Either way, we return an error code, as the *new* listener should be released...
+                if(l->flags & MESSAGE_BUS_LISTENER_DELETING)
+                    l->flags &= ~MESSAGE_BUS_LISTENER_DELETING;
 
-    //add at front of list
-    if (p == listeners && (newListener->id < p->id || (p->id == newListener->id && p->value > newListener->value)))
-    {
-        newListener->next = p;
+                return DEVICE_NOT_SUPPORTED;
+            }
 
-        //this new listener is now the front!
-        listeners = newListener;
+            l = l->next;
+        }
     }
 
-    //add after p
-    else
-    {
-        newListener->next = p->next;
-        p->next = newListener;
-    }
+    // We have a valid, new event handler. Add it to the table matching its urgency.
+    Listener **table = (newListener->flags & MESSAGE_BUS_LISTENER_IMMEDIATE) == MESSAGE_BUS_LISTENER_IMMEDIATE ? urgentListeners : listeners;
+    listener_insert(&table[listener_bucket(newListener->id)], newListener);
 
     Event(DEVICE_ID_MESSAGE_BUS_LISTENER, newListener->id);
     return DEVICE_OK;
@@ -502,39 +1020,46 @@ int MessageBus::add(Listener *newListener)
 int MessageBus::remove(Listener *listener)
 {
     Listener *l;
+    Listener **tables[2] = { listeners, urgentListeners };
     int removed = 0;
 
     //handler can't be NULL!
     if (listener == NULL)
         return DEVICE_INVALID_PARAMETER;
 
-    l = listeners;
-
-    // Walk this list of event handlers. Delete any that match the given listener.
-    while (l != NULL)
+    // Walk each list of event handlers that could hold a match. Delete any that match the given listener.
+    // A listener for a specific id can only match handlers held in that id's bucket.
+    for (int t = 0; t < 2; t++)
     {
-        if ((listener->flags & MESSAGE_BUS_LISTENER_METHOD) == (l->flags & MESSAGE_BUS_LISTENER_METHOD))
+        for (int b = 0; b <= MESSAGE_BUS_LISTENER_BUCKETS; b++)
         {
-            if(((listener->flags & MESSAGE_BUS_LISTENER_METHOD) && (*l->cb_method == *listener->cb_method)) ||
-              ((!(listener->flags & MESSAGE_BUS_LISTENER_METHOD) && l->cb == listener->cb)))
+            if (listener->id != DEVICE_ID_ANY && b != listener_bucket(listener->id))
+                continue;
+
+            for (l = tables[t][b]; l != NULL; l = l->next)
             {
-                if ((listener->id == DEVICE_ID_ANY || listener->id == l->id) && (listener->value == DEVICE_EVT_ANY || listener->value == l->value))
+                if ((listener->flags & MESSAGE_BUS_LISTENER_METHOD) == (l->flags & MESSAGE_BUS_LISTENER_METHOD))
                 {
-                    // If notification of deletion has been requested, invoke the listener deletion callback.
-                    if (listener_deletion_callback)
-                        listener_deletion_callback(l);
-
-                    // Found a match. mark this to be removed from the list.
-                    l->flags |= MESSAGE_BUS_LISTENER_DELETING;
-                    removed++;
-
-                    // Raise an event to indicate the removal
-                    Event(DEVICE_ID_MESSAGE_BUS_IGNORED, l->id);
+                    if(((listener->flags & MESSAGE_BUS_LISTENER_METHOD) && (*l->cb_method == *listener->cb_method)) ||
+                      ((!(listener->flags & MESSAGE_BUS_LISTENER_METHOD) && l->cb == listener->cb)))
+                    {
+                        if ((listener->id == DEVICE_ID_ANY || listener->id == l->id) && (listener->value == DEVICE_EVT_ANY || listener->value == l->value))
+                        {
+                            // If notification of deletion has been requested, invoke the listener deletion callback.
+                            if (listener_deletion_callback)
+                                listener_deletion_callback(l);
+
+                            // Found a match. mark this to be removed from the list.
+                            l->flags |= MESSAGE_BUS_LISTENER_DELETING;
+                            removed++;
+
+                            // Raise an event to indicate the removal
+                            Event(DEVICE_ID_MESSAGE_BUS_IGNORED, l->id);
+                        }
+                    }
                 }
             }
         }
-
-        l = l->next;
     }
 
     if (removed > 0)
@@ -552,18 +1077,134 @@ int MessageBus::remove(Listener *listener)
   */
 Listener* MessageBus::elementAt(int n)
 {
-    Listener *l = listeners;
+    Listener **tables[2] = { listeners, urgentListeners };
 
-    while (n > 0)
+    for (int t = 0; t < 2; t++)
     {
-        if (l == NULL)
-            return NULL;
+        for (int b = 0; b <= MESSAGE_BUS_LISTENER_BUCKETS; b++)
+        {
+            for (Listener *l = tables[t][b]; l != NULL; l = l->next)
+            {
+                if (n == 0)
+                    return l;
 
-        n--;
-        l = l->next;
+                n--;
+            }
+        }
     }
 
-    return l;
+    return NULL;
+}
+
+/**
+  * Enables or disables coalescing of the queued events raised by the given source.
+  *
+  * While coalescing is enabled, an event that needs to be queued is merged into any identical event
+  * (same source and value) still waiting in the queue, rather than taking a place of its own. The queued
+  * event takes the timestamp of the latest event, and counts how many events were merged into it.
+  * Urgent listeners still receive every event. Merging happens even when the queue is full, so the
+  * latest state of a coalescing source is never lost.
+  *
+  * @param id The id of the event source.
+  *
+  * @param enable true to merge identical queued events from this source, false to queue each event.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if id is DEVICE_ID_ANY, or DEVICE_NO_RESOURCES
+  *         if MESSAGE_BUS_COALESCE_SOURCES sources already have coalescing enabled.
+  */
+int MessageBus::setCoalescing(uint16_t id, bool enable)
+{
+    if (id == DEVICE_ID_ANY)
+        return DEVICE_INVALID_PARAMETER;
+
+#if MESSAGE_BUS_COALESCE_SOURCES > 0
+    int freeSlot = -1;
+
+    for (int i = 0; i < MESSAGE_BUS_COALESCE_SOURCES; i++)
+    {
+        if (coalesceIds[i] == id)
+        {
+            if (!enable)
+                coalesceIds[i] = DEVICE_ID_ANY;
+
+            return DEVICE_OK;
+        }
+
+        if (coalesceIds[i] == DEVICE_ID_ANY && freeSlot < 0)
+            freeSlot = i;
+    }
+
+    if (!enable)
+        return DEVICE_OK;
+
+    if (freeSlot >= 0)
+    {
+        coalesceIds[freeSlot] = id;
+        return DEVICE_OK;
+    }
+#endif
+
+    return enable ? DEVICE_NO_RESOURCES : DEVICE_OK;
+}
+
+/**
+  * Determines how many events were merged into the event currently being delivered to a standard listener.
+  * The count travels with the event to worker fibers and listener queues, so it is valid in any standard
+  * handler, but only until that handler blocks. It is not recorded for urgent handlers or batch handlers.
+  *
+  * @return the number of identical events merged into the current event, up to 255.
+  */
+int MessageBus::getMergedCount()
+{
+    return handlerMerged;
+}
+
+/**
+  * Selects what happens to an event that needs to be queued when the queue is full.
+  *
+  * @param policy The new overflow policy.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the policy is not recognised.
+  */
+int MessageBus::setOverflowPolicy(MessageBusOverflowPolicy policy)
+{
+    if (policy > MESSAGE_BUS_OVERFLOW_GROW)
+        return DEVICE_INVALID_PARAMETER;
+
+    overflowPolicy = policy;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Provides the statistics gathered about the event queue, since the MessageBus was created or the
+  * statistics were last reset.
+  *
+  * @param stats Updated with the current statistics.
+  *
+  * @param reset true to reset the statistics once read. Defaults to false.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if stats is NULL.
+  */
+int MessageBus::getStatistics(MessageBusStatistics *stats, bool reset)
+{
+    if (stats == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+
+    this->stats.size = queueSize;
+    *stats = this->stats;
+
+    if (reset)
+    {
+        memset(&this->stats, 0, sizeof(this->stats));
+        this->stats.maxDepth = queueLength;
+    }
+
+    target_enable_irq();
+
+    return DEVICE_OK;
 }
 
 namespace codal {
@@ -583,5 +1224,4 @@ uint16_t allocateNotifyEvent()
   */
 MessageBus::~MessageBus()
 {
-    ignore(DEVICE_ID_SCHEDULER, DEVICE_EVT_ANY, this, &MessageBus::idle);
 }
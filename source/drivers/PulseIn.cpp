@@ -28,8 +28,6 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
-bool PulseIn::timeoutGeneratorStarted = false;
-
 /**
  * Creates a new instance of a synchronous pulse detector ont he given pin.
  * 
@@ -60,25 +58,15 @@ PulseIn::awaitPulse(int timeout)
         // Configure the requested pin to supply pulse events.
         pin.eventOn(DEVICE_PIN_EVENT_ON_PULSE);
         EventModel::defaultEventBus->listen(pin.id, pin.getPolarity() ? DEVICE_PIN_EVT_PULSE_HI : DEVICE_PIN_EVT_PULSE_LO, this, &PulseIn::onPulse, MESSAGE_BUS_LISTENER_IMMEDIATE);
-        EventModel::defaultEventBus->listen(DEVICE_ID_PULSE_IN, DEVICE_EVT_PULSE_IN_TIMEOUT, this, &PulseIn::onTimeout, MESSAGE_BUS_LISTENER_IMMEDIATE);
-
-        if (!timeoutGeneratorStarted)
-        {
-            system_timer_event_every_us(10000, DEVICE_ID_PULSE_IN, DEVICE_EVT_PULSE_IN_TIMEOUT);
-            timeoutGeneratorStarted = true;
-        }
 
         enabled = true;
     }
 
-    if (timeout)
-        this->timeout = system_timer_current_time_us() + timeout;
-    else
-        this->timeout = 0;
-    
     lastPeriod = 0;
 
-    lock.wait();
+    // The scheduler tracks the timeout for us, with millisecond resolution.
+    if (lock.wait(timeout ? (timeout + 999) / 1000 : 0) == DEVICE_TIMEOUT)
+        return DEVICE_CANCELLED;
 
     if (lastPeriod != 0)
         return lastPeriod;
@@ -92,7 +80,6 @@ PulseIn::awaitPulse(int timeout)
 void
 PulseIn::onPulse(Event e)
 {
-    timeout = 0;
     lastPeriod = (uint32_t) e.timestamp;
     
     // Wake any blocked fibers and reset the lock.
@@ -100,23 +87,6 @@ PulseIn::onPulse(Event e)
     lock.wait();
 }
 
-/**
- * Event handler called when a timeout event is generated.
- */
-void
-PulseIn::onTimeout(Event e)
-{
-    if (timeout && system_timer_current_time_us() > timeout)
-    {
-        timeout = 0;
-        lastPeriod = 0;
-
-        // Wake any blocked fibers and reset the lock.
-        lock.notifyAll();
-        lock.wait();
-    }
-}
-
 /**
  * Method to release the given pin from a peripheral, if already bound.
  * Device drivers should override this method to disconnect themselves from the give pin
@@ -143,9 +113,7 @@ void PulseIn::disable()
     {
         enabled = false;
         EventModel::defaultEventBus->ignore(pin.id, pin.getPolarity() ? DEVICE_PIN_EVT_PULSE_HI : DEVICE_PIN_EVT_PULSE_LO, this, &PulseIn::onPulse);
-        EventModel::defaultEventBus->ignore(DEVICE_ID_PULSE_IN, DEVICE_EVT_PULSE_IN_TIMEOUT, this, &PulseIn::onTimeout);
         //pin.eventOn(DEVICE_PIN_EVENT_NONE);
-        timeout = 0;
         lastPeriod = 0;
         lock.notifyAll();
     }
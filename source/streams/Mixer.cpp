@@ -25,6 +25,7 @@ DEALINGS IN THE SOFTWARE.
 #include "Mixer.h"
 #include "ErrorNo.h"
 #include "CodalDmesg.h"
+#include "CodalArena.h"
 
 using namespace codal;
 
@@ -59,7 +60,7 @@ MixerChannel *Mixer::addChannel(DataStream &stream)
 
 ManagedBuffer Mixer::pull() {
     if (!channels)
-        return ManagedBuffer(512);
+        return ManagedBuffer(512, BufferInitialize::Zero, DEVICE_HEAP_DMA);
 
     ManagedBuffer sum;
     MixerChannel *next;
@@ -70,7 +71,7 @@ ManagedBuffer Mixer::pull() {
         int vol = ch->volume;
         ManagedBuffer data = ch->stream->pull();
         if (sum.length() < data.length()) {
-            ManagedBuffer newsum(data.length());
+            ManagedBuffer newsum(data.length(), ArenaScope::current());
             newsum.writeBuffer(0, sum);
             sum = newsum;
         }
@@ -25,6 +25,7 @@ DEALINGS IN THE SOFTWARE.
 #include "StreamNormalizer.h"
 #include "ErrorNo.h"
 #include "CodalDmesg.h"
+#include "CodalArena.h"
 
 using namespace codal;
 
@@ -168,11 +169,11 @@ ManagedBuffer StreamNormalizer::pull()
     ManagedBuffer inputBuffer = upStream.pull();
     samples = inputBuffer.length() / bytesPerSampleIn;
 
-    // Use in place processing where possible, but allocate a new buffer when needed.
+    // Use in place processing where possible, but allocate a new buffer when needed (from the current arena, if any).
     if (DATASTREAM_FORMAT_BYTES_PER_SAMPLE(inputFormat) == DATASTREAM_FORMAT_BYTES_PER_SAMPLE(outputFormat))
         buffer = inputBuffer;
     else
-        buffer = ManagedBuffer(samples * bytesPerSampleOut);
+        buffer = ManagedBuffer(samples * bytesPerSampleOut, ArenaScope::current());
     
     // Initialise input and output buffer pointers.
     data = &inputBuffer[0];
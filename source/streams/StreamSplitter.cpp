@@ -28,6 +28,7 @@ DEALINGS IN THE SOFTWARE.
 #include "ErrorNo.h"
 #include "Event.h"
 #include "CodalDmesg.h"
+#include "CodalArena.h"
 
 using namespace codal;
 
@@ -55,7 +56,7 @@ ManagedBuffer SplitterChannel::resample( ManagedBuffer _in, uint8_t *buffer, int
     int numOutputSamples = (totalSamples / sampleDropRate) + 1;
     uint8_t *outPtr = NULL;
 
-    ManagedBuffer output = ManagedBuffer(numOutputSamples * bytesPerSample);
+    ManagedBuffer output = ManagedBuffer(numOutputSamples * bytesPerSample, ArenaScope::current());
     outPtr = output.getBytes();
 
     for (int i = 0; i < totalSamples * bytesPerSample; i++)
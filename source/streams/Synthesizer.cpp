@@ -206,7 +206,7 @@ void Synthesizer::generate(int playoutTimeUs, int envelopeStart, int envelopeEnd
     while(playoutSamples != 0)
     {
         if (bytesWritten == 0)
-            buffer = ManagedBuffer(bufferSize);
+            buffer = ManagedBuffer(bufferSize, BufferInitialize::Zero, DEVICE_HEAP_DMA);
 
         uint16_t *ptr = (uint16_t *) &buffer[bytesWritten];
 
@@ -0,0 +1,177 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * A fixed size ring of events, pushed by an interrupt handler and delivered later in thread context.
+  */
+#include "CodalConfig.h"
+#include "EventRing.h"
+#include "ErrorNo.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+EventRing *EventRing::rings = NULL;
+
+/**
+  * Constructor.
+  *
+  * Creates a new EventRing, and adds it to the list of rings drained by the MessageBus.
+  *
+  * @param size The number of events this ring may hold. If zero, events are raised as soon as they are pushed.
+  *             Defaults to CODAL_EVENT_RING_SIZE.
+  */
+EventRing::EventRing(uint8_t size)
+{
+    this->slots = NULL;
+    this->size = 0;
+    this->head = 0;
+    this->tail = 0;
+    this->next = NULL;
+    this->dropped = 0;
+
+    if (size == 0)
+        return;
+
+    this->slots = new Event[size + 1];
+
+    if (this->slots == NULL)
+        return;
+
+    this->size = size;
+
+    target_disable_irq();
+    this->next = rings;
+    rings = this;
+    target_enable_irq();
+}
+
+/**
+  * Adds the given event to this ring, to be delivered in thread context. Safe to call from an interrupt handler.
+  *
+  * @param evt The event to deliver, normally created using the CREATE_ONLY launch mode.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the ring is full and the event was dropped.
+  */
+REAL_TIME_FUNC
+int EventRing::push(Event evt)
+{
+    if (size == 0)
+    {
+        evt.fire();
+        return DEVICE_OK;
+    }
+
+    uint8_t h = head;
+    uint8_t newHead = h + 1 > size ? 0 : h + 1;
+
+    if (newHead == tail)
+    {
+        dropped++;
+        return DEVICE_NO_RESOURCES;
+    }
+
+    slots[h] = evt;
+
+    // Ensure the event is stored before the consumer can see it.
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+
+    head = newHead;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Removes the oldest event from this ring. Must only be called in thread context.
+  *
+  * @param evt Updated with the oldest event in the ring.
+  *
+  * @return DEVICE_OK on success, or DEVICE_NO_DATA if the ring is empty.
+  */
+int EventRing::pop(Event &evt)
+{
+    uint8_t t = tail;
+
+    if (t == head)
+        return DEVICE_NO_DATA;
+
+    // Ensure the event is read only after we've seen that it has been stored.
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+
+    evt = slots[t];
+
+    // Ensure the event has been read before its slot can be reused by the producer.
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+
+    tail = t + 1 > size ? 0 : t + 1;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Raises every event held in every EventRing, in the order in which they were pushed onto each ring.
+  * Called by the MessageBus when the scheduler is idle.
+  *
+  * @return the number of events raised.
+  */
+int EventRing::drain()
+{
+    Event evt;
+    int raised = 0;
+
+    for (EventRing *r = rings; r != NULL; r = r->next)
+    {
+        while (r->pop(evt) == DEVICE_OK)
+        {
+            evt.fire();
+            raised++;
+        }
+    }
+
+    return raised;
+}
+
+/**
+  * Destructor. Removes this ring from the list of rings drained by the MessageBus.
+  * Any events still held in the ring are discarded.
+  */
+EventRing::~EventRing()
+{
+    if (slots == NULL)
+        return;
+
+    target_disable_irq();
+
+    EventRing **p = &rings;
+
+    while (*p != NULL && *p != this)
+        p = &(*p)->next;
+
+    if (*p != NULL)
+        *p = next;
+
+    target_enable_irq();
+
+    delete[] slots;
+}
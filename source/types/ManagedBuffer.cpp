@@ -25,6 +25,7 @@ DEALINGS IN THE SOFTWARE.
 #include "ManagedBuffer.h"
 #include <limits.h>
 #include "CodalCompat.h"
+#include "CodalArena.h"
 
 #define REF_TAG REF_TAG_BUFFER
 #define EMPTY_DATA ((BufferData*)(void*)emptyData)
@@ -74,6 +75,43 @@ ManagedBuffer::ManagedBuffer(int length, BufferInitialize initialize)
     this->init(NULL, length, initialize);
 }
 
+/**
+ * Constructor.
+ * Creates a new ManagedBuffer of the given size, in the given arena if it has space, or otherwise on the heap.
+ * A buffer held in an arena must not be referenced after the ArenaScope it was created within ends.
+ *
+ * @param length The length of the buffer to create.
+ * @param arena The arena to create the buffer in, or NULL to create it on the heap.
+ *
+ * Example:
+ * @code
+ * ManagedBuffer p(256, ArenaScope::current());    // Creates a 256 byte buffer, in the current arena if any.
+ * @endcode
+ */
+ManagedBuffer::ManagedBuffer(int length, CodalArena *arena, BufferInitialize initialize)
+{
+    this->init(NULL, length, initialize, arena);
+}
+
+/**
+ * Constructor.
+ * Creates a new ManagedBuffer of the given size, placed on the heap according to the given hint.
+ *
+ * @param length The length of the buffer to create.
+ * @param initialize The initialization mode to use for the buffer.
+ * @param heapHint The intended use of the buffer (any of DEVICE_HEAP_FAST, DEVICE_HEAP_LARGE, DEVICE_HEAP_DMA).
+ * DEVICE_HEAP_DMA is a requirement, so should only be given for buffers passed to a DMA controller.
+ *
+ * Example:
+ * @code
+ * ManagedBuffer p(512, BufferInitialize::None, DEVICE_HEAP_DMA);  // Creates a 512 byte buffer a DMA controller can read.
+ * @endcode
+ */
+ManagedBuffer::ManagedBuffer(int length, BufferInitialize initialize, uint8_t heapHint)
+{
+    this->init(NULL, length, initialize, NULL, heapHint);
+}
+
 /**
  * Constructor.
  * Creates a new ManagedBuffer of the given size,
@@ -129,17 +167,37 @@ ManagedBuffer::ManagedBuffer(BufferData *p)
  * @param data The data with which to fill the buffer.
  * @param length The length of the buffer to create.
  * @param initialize The initialization mode to use for the allocted memory in the buffer
+ * @param arena The arena to create the buffer in, or NULL to create it on the heap.
+ * @param heapHint The heap allocation hint used if the buffer is created on the heap (see device_malloc_hint()).
  *
  */
-void ManagedBuffer::init(uint8_t *data, int length, BufferInitialize initialize)
+void ManagedBuffer::init(uint8_t *data, int length, BufferInitialize initialize, CodalArena *arena, uint8_t heapHint)
 {
     if (length <= 0) {
         initEmpty();
         return;
     }
 
-    ptr = (BufferData *) malloc(sizeof(BufferData) + length);
-    REF_COUNTED_INIT(ptr);
+    ptr = arena ? (BufferData *) arena->allocate(sizeof(BufferData) + length, true) : NULL;
+
+    if (ptr)
+    {
+        // Arena memory is not part of the heap, so is not recorded in the heap statistics.
+        ptr->init();
+#if CONFIG_ENABLED(DEVICE_TAG)
+        ptr->tag = REF_TAG;
+#endif
+    }
+    else
+    {
+        uint8_t hint = heapHint;
+
+        if (CODAL_MANAGED_BUFFER_LARGE_SIZE > 0 && length >= CODAL_MANAGED_BUFFER_LARGE_SIZE)
+            hint |= DEVICE_HEAP_LARGE;
+
+        ptr = (BufferData *) device_malloc_hint(sizeof(BufferData) + length, hint);
+        REF_COUNTED_INIT(ptr);
+    }
 
     ptr->length = length;
 
@@ -29,6 +29,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 #include "CodalDevice.h"
 #include "RefCounted.h"
+#include "CodalArena.h"
 
 using namespace codal;
 
@@ -83,6 +84,13 @@ void RefCounted::decr()
         return;
 
     if (__sync_fetch_and_add(&refCount, -2) == 3 ) {
+        // Objects held in an arena are released when their scope ends.
+        if (CodalArena::release(this))
+            return;
+
+#if CONFIG_ENABLED(DEVICE_TAG)
+        DEVICE_HEAP_UNTAG(this, tag);
+#endif
         destroy();
     }
 }